@@ -0,0 +1,180 @@
+#include "KestoG_Book.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kestog_core {
+
+    constexpr uint32_t BOOK_FILE_VERSION = 2;
+
+    // Ключ начальной позиции в заголовке: книга, построенная с другими ключами Zobrist,
+    // не подключится
+    struct BookFileHeader {
+        char magic[8];         // "KESTOGBK"
+        uint32_t version;
+        uint32_t entry_bytes;  // sizeof(BookEntry)
+        u64 start_key;
+        u64 count;
+        uint32_t plies;        // параметры построения
+        uint32_t depth;
+    };
+
+    const BookEntry* book_entries = nullptr;
+    u64 book_count = 0;
+    void* book_mapping = nullptr;
+    size_t book_mapping_size = 0;
+
+    const Bitboard BOOK_START_POSITION = {0x00000FFFULL, 0xFFF00000ULL, 0, 0};
+
+    inline uint16_t encode_book_move(const Move& m) {
+        return (uint16_t)(__builtin_ctzll(m.mask_from) | (__builtin_ctzll(m.mask_to) << 5));
+    }
+
+    inline bool book_move_matches(const BookEntry& entry, const Move& m) {
+        return entry.move == encode_book_move(m) && entry.captured == (uint32_t)m.captured_pieces;
+    }
+
+    void release_book() {
+        if (book_mapping) munmap(book_mapping, book_mapping_size);
+        book_mapping = nullptr;
+        book_mapping_size = 0;
+        book_entries = nullptr;
+        book_count = 0;
+    }
+
+    long long book_init(const std::string& path) {
+        release_book();
+        if (path.empty()) return 0;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return 0;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BookFileHeader)) {
+            close(fd);
+            return 0;
+        }
+        size_t file_size = (size_t)st.st_size;
+        void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return 0;
+        const BookFileHeader* header = static_cast<const BookFileHeader*>(mapping);
+        bool valid = std::memcmp(header->magic, "KESTOGBK", 8) == 0 && header->version == BOOK_FILE_VERSION &&
+                     header->entry_bytes == sizeof(BookEntry) &&
+                     header->start_key == calculate_hash(BOOK_START_POSITION, 1) &&
+                     file_size == sizeof(BookFileHeader) + header->count * sizeof(BookEntry);
+        if (!valid) {
+            munmap(mapping, file_size);
+            return 0;
+        }
+        book_mapping = mapping;
+        book_mapping_size = file_size;
+        book_entries = reinterpret_cast<const BookEntry*>(static_cast<const char*>(mapping) + sizeof(BookFileHeader));
+        book_count = header->count;
+        return (long long)book_count;
+    }
+
+    // Первая запись с ключом key или book_count. Интерполяционный поиск: следующая проба
+    // берётся там, где ключ лежал бы при равномерном распределении ключей на [lo, hi]
+    size_t find_book_key(u64 key) {
+        if (!book_count) return 0;
+        size_t lo = 0, hi = book_count - 1;
+        while (lo <= hi && key >= book_entries[lo].key && key <= book_entries[hi].key) {
+            u64 lo_key = book_entries[lo].key, hi_key = book_entries[hi].key;
+            size_t pos = lo;
+            if (hi_key > lo_key) {
+                pos += (size_t)((unsigned __int128)(key - lo_key) * (hi - lo) / (hi_key - lo_key));
+            }
+            if (book_entries[pos].key < key) {
+                lo = pos + 1;
+            } else if (book_entries[pos].key > key) {
+                if (pos == 0) break;
+                hi = pos - 1;
+            } else {
+                while (pos > 0 && book_entries[pos - 1].key == key) --pos;
+                return pos;
+            }
+        }
+        return book_count;
+    }
+
+    bool book_probe(const Bitboard& board, int color_to_move, Move& move, int& score) {
+        if (!book_count) return false;
+        u64 key = calculate_hash(board, color_to_move);
+        size_t first = find_book_key(key);
+        if (first == book_count) return false;
+        MoveList moves;
+        generate_legal_moves(board, color_to_move, moves);
+        // Совпадение ключа проверяем легальностью хода: коллизия не даст сыграть чужой ход
+        for (size_t i = first; i < book_count && book_entries[i].key == key; ++i) {
+            const BookEntry& entry = book_entries[i];
+            for (const auto& m : moves) {
+                if (book_move_matches(entry, m)) {
+                    move = m;
+                    score = entry.score;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    long long book_build(const std::string& path, int plies, int depth, int time_limit_ms, int num_workers) {
+        // Все различные позиции первых plies полуходов (обход в ширину)
+        std::vector<Bitboard> boards;
+        std::vector<int> colors;
+        std::unordered_set<u64> seen;
+        std::vector<Bitboard> level = {BOOK_START_POSITION};
+        level[0].hash = calculate_hash(BOOK_START_POSITION, 1);
+        seen.insert(level[0].hash);
+        int color = 1;
+        for (int ply = 0; ply < plies; ++ply) {
+            std::vector<Bitboard> next_level;
+            for (const auto& board : level) {
+                MoveList moves;
+                generate_legal_moves(board, color, moves);
+                if (moves.size() > 1) {
+                    boards.push_back(board);
+                    colors.push_back(color);
+                }
+                for (const auto& m : moves) {
+                    Bitboard next = apply_move(board, m, color);
+                    if (seen.insert(next.hash).second) next_level.push_back(next);
+                }
+            }
+            level.swap(next_level);
+            color = 3 - color;
+        }
+
+        std::vector<SearchResult> results = analyze_positions(boards, colors, depth, time_limit_ms, num_workers);
+        std::vector<BookEntry> entries;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const SearchResult& r = results[i];
+            if (!r.best_move.mask_from) continue;
+            entries.push_back({boards[i].hash, (uint32_t)r.best_move.captured_pieces, encode_book_move(r.best_move),
+                               (int16_t)r.score});
+        }
+        std::sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+            return a.key < b.key;
+        });
+
+        BookFileHeader header{};
+        std::memcpy(header.magic, "KESTOGBK", 8);
+        header.version = BOOK_FILE_VERSION;
+        header.entry_bytes = sizeof(BookEntry);
+        header.start_key = calculate_hash(BOOK_START_POSITION, 1);
+        header.count = entries.size();
+        header.plies = plies;
+        header.depth = depth;
+        FILE* out = std::fopen(path.c_str(), "wb");
+        if (!out) return -1;
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  std::fwrite(entries.data(), sizeof(BookEntry), entries.size(), out) == entries.size();
+        ok = (std::fclose(out) == 0) && ok;
+        return ok ? (long long)entries.size() : -1;
+    }
+}
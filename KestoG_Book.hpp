@@ -0,0 +1,33 @@
+#pragma once
+#include "KestoG_Core.hpp"
+#include <cstdint>
+#include <string>
+
+namespace kestog_core {
+
+    // --- Дебютная книга ---
+    // Файл - заголовок и массив записей, отсортированный по ключу (calculate_hash позиции
+    // со стороной на ходу), по одной записи на позицию. Файл отображается в память; ключи
+    // Zobrist распределены равномерно, поэтому интерполяционный поиск находит запись за
+    // пару обращений.
+    struct BookEntry {
+        u64 key;
+        uint32_t captured;  // взятые шашки хода: взятия дамкой с одними from/to различаются только ими
+        uint16_t move;      // поле from в битах 0-4, поле to в битах 5-9
+        int16_t score;      // оценка хода за сторону на ходу
+    };
+    static_assert(sizeof(BookEntry) == 16, "запись книги должна оставаться 16-байтной");
+
+    // Строит книгу глубоким поиском всех позиций первых plies полуходов от начальной
+    // расстановки (позиции с единственным ходом пропускаются) на пуле num_workers
+    // потоков и записывает её в path. Глубина анализа хранится в заголовке файла.
+    // Требует init_engine. Возвращает число записей (-1 при ошибке записи).
+    long long book_build(const std::string& path, int plies, int depth, int time_limit_ms, int num_workers = 0);
+
+    // Подключает (mmap) книгу; пустой путь отключает книгу. Возвращает число записей
+    // (0, если книги нет или файл не подходит к ключам Zobrist движка).
+    long long book_init(const std::string& path);
+
+    // Легальный ход из книги для позиции и его оценка; false, если позиции в книге нет
+    bool book_probe(const Bitboard& board, int color_to_move, Move& move, int& score);
+}
@@ -1,96 +1,364 @@
 #include "KestoG_Core.hpp"
+#include "KestoG_Tablebase.hpp"
+#include "KestoG_NNUE.hpp"
+#include "KestoG_Book.hpp"
 #include <vector>
 #include <random>
 #include <chrono>
 #include <algorithm>
 #include <iostream>
-#include <cstring> // Для memset
+#include <cstring> // memcpy/memcmp заголовка файла ТТ
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <limits>
+#include <stdexcept>
+#include <cstdio>  // fwrite для файлов самоигры
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap/msync для файла ТТ
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define popcount __builtin_popcountll
 #define bitscan_forward __builtin_ffsll
 
+// Счётчики профилирования (SearchStats): без KESTOG_STATS макросы пустые, и в горячем
+// коде не остаётся ни счётчиков, ни замеров времени. STAT_TIMED(поле, оператор)
+// выполняет оператор в любой сборке, а со статистикой добавляет его время в поле.
+#ifdef KESTOG_STATS
+#define STAT(...) do { __VA_ARGS__; } while (0)
+#define STAT_TIMED(field, ...) do { \
+        auto stat_start_ = std::chrono::steady_clock::now(); \
+        __VA_ARGS__; \
+        field += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - stat_start_).count(); \
+    } while (0)
+#else
+#define STAT(...) do {} while (0)
+#define STAT_TIMED(field, ...) do { __VA_ARGS__; } while (0)
+#endif
+
 namespace kestog_core {
 
     // --- Глобальные переменные движка ---
     constexpr int MAX_PLY = 64;
     constexpr int MATE_SCORE = 10000;
     constexpr int INFINITY_SCORE = 10001;
+    // Выигрыш по таблицам: ниже любого мата в пределах MAX_PLY, чтобы найденный
+    // поиском мат был предпочтительнее и итерации не обрывались на табличной оценке
+    constexpr int TB_WIN_SCORE = MATE_SCORE - 2 * MAX_PLY;
+
+    // --- Управление временем ---
+    // time_limit_ms - жёсткий лимит: по нему поиск обрывается посреди итерации.
+    // Новую итерацию не начинаем после мягкого лимита (доля жёсткого), который
+    // сжимается, пока лучший ход стабилен, и растягивается, когда оценка падает.
+    constexpr double TM_SOFT_FRACTION = 0.4;
+    constexpr double TM_MIN_STABILITY_SCALE = 0.5;  // при давно не меняющемся ходе
+    constexpr double TM_STABILITY_STEP = 0.1;       // за каждую итерацию с тем же ходом
+    constexpr int TM_SCORE_DROP = 30;               // падение оценки, продлевающее поиск в 1.5 раза
+    constexpr int TM_SCORE_COLLAPSE = 100;          // ... в 2 раза
 
     // Zobrist Hashing
+    constexpr u64 ZOBRIST_SEED = 0xdeadbeef;
     u64 ZOBRIST[32][4]; // [square][piece_type: wm, bm, wk, bk]
     u64 ZOBRIST_BLACK_TO_MOVE;
 
-    // Транспозиционная таблица
-    std::vector<TT_Entry> transposition_table;
-    u64 tt_mask;
+    // Транспозиционная таблица (общая для всех потоков, без блокировок).
+    // Корзина занимает одну кеш-линию и содержит TT_BUCKET_SIZE записей по 16 байт.
+    // Запись хранит ключ, сложенный по XOR с упакованными данными: если другой поток
+    // успел переписать запись между чтениями, ключ не сойдётся и запись будет отброшена.
+    constexpr int TT_BUCKET_SIZE = 4;
+    struct TT_Slot {
+        std::atomic<u64> key;  // hash ^ data
+        std::atomic<u64> data; // см. pack_tt_data
+    };
+    struct alignas(64) TT_Bucket {
+        TT_Slot slots[TT_BUCKET_SIZE];
+    };
+    TT_Bucket* transposition_table = nullptr;
+    u64 tt_mask; // маска индекса корзины
+    std::atomic<uint8_t> tt_generation{0}; // увеличивается с каждым поиском, 6 бит
+    constexpr int TT_GENERATION_MASK = 63;
+
+    // Файл ТТ: заголовок на одну кеш-линию, за ним корзины как есть. Файл отображается
+    // в память (MAP_SHARED), поэтому загрузка не копирует данные, а сохранение - это msync.
+    // Версия, seed и свёртка ключей Zobrist защищают от чтения несовместимой таблицы.
+    constexpr uint32_t TT_FILE_VERSION = 1;
+    struct alignas(64) TT_FileHeader {
+        char magic[8];          // "KESTOGTT"
+        uint32_t version;       // TT_FILE_VERSION, меняется вместе с форматом записи
+        uint32_t bucket_bytes;  // sizeof(TT_Bucket)
+        u64 zobrist_seed;
+        u64 zobrist_check;      // XOR-свёртка всех ключей Zobrist
+        u64 bucket_count;
+        uint32_t generation;    // поколение на момент сохранения
+    };
+
+    // Хранилище ТТ: либо память процесса, либо отображённый файл
+    std::unique_ptr<TT_Bucket[]> tt_heap_storage;
+    void* tt_mapping = nullptr;
+    size_t tt_mapping_size = 0;
+
+    struct RootLine {
+        Move move;
+        int score;
+        int pv_length;
+        Move pv[MAX_PLY];
+    };
+
+    // Всё, что нужно unmake_move, чтобы вернуть доску поиска к позиции до хода
+    struct UndoInfo {
+        u64 from_to;      // XOR полей from и to (при круговом взятии 0)
+        u64 captured;     // взятые фигуры соперника
+        u64 kings;        // признаки дамок до хода
+        u64 hash_delta;   // приращение Zobrist-хеша
+    };
 
-    // Эвристики упорядочивания ходов
-    Move killer_moves[MAX_PLY][2];
-    int history[32][32];
+    // Кадр стека поиска на один полуход: отмена сделанного из него хода, аккумулятор
+    // NNUE позиции этого полухода и её список ходов. Списки живут здесь, в куче ThreadData,
+    // а не на стеке потока: по 8 КБ на полуход глубокий вариант не уместил бы в стек
+    // рабочего потока (на macOS он 512 КБ)
+    struct SearchFrame {
+        UndoInfo undo;
+        NNUE_Accumulator accumulator;
+        MoveList moves;
+    };
+
+    // Данные одного потока поиска: эвристики упорядочивания и собственный счётчик узлов
+    struct ThreadData {
+        int id;
+        SearchContext* ctx;
+        Move killer_moves[MAX_PLY][2];
+        int history[32][32];
+        long long nodes;
+        long long tt_probes;
+        long long tt_hits;
+        long long tb_hits;
+        Move root_best_move;
+        int best_score;
+        int completed_depth;
+        // Треугольная таблица вариантов: pv[ply][ply..pv_length[ply]) - лучший вариант из узла ply
+        Move pv[MAX_PLY + 1][MAX_PLY + 1];
+        int pv_length[MAX_PLY + 1];
+        // MultiPV: уже найденные в текущей итерации ходы корня исключаются из следующего поиска
+        Move root_excluded[MAX_MULTI_PV];
+        int root_excluded_count;
+        // Строки последней завершённой итерации
+        RootLine root_lines[MAX_MULTI_PV];
+        int root_line_count;
+        // Лучший полностью просмотренный ход корня в текущей (возможно, прерванной) итерации
+        RootLine partial_line;
+        // Стек поиска по ply: negamax пишет [ply], взятия форсированного поиска
+        // продолжают стек дальше (он не глубже 10 полуходов от листа)
+        SearchFrame frames[MAX_PLY + 16];
+#ifdef KESTOG_STATS
+        SearchStats stats;
+#endif
+    };
 
-    // Статистика
-    long long nodes_searched;
-    std::chrono::steady_clock::time_point search_start_time;
-    int time_limit_ms;
-    bool stop_search_flag;
+    // Контекст одного поиска: всё, что раньше было глобальным состоянием поиска.
+    // Независимые контексты могут работать одновременно (разные партии на сервере).
+    struct SearchContext {
+        Bitboard root_board;
+        int color_to_move;
+        int max_depth;
+        int time_limit_ms;      // жёсткий лимит
+        double soft_limit_ms;   // базовый мягкий лимит, см. TM_SOFT_FRACTION
+        int root_move_count;
+        int best_move_stability; // итераций подряд с тем же лучшим ходом
+        Move previous_best_move;
+        int multi_pv = 1;
+        SearchOptions options;
+        std::chrono::steady_clock::time_point search_start_time;
+        // Обдумывание на времени соперника: лимиты времени не действуют, пока не придёт
+        // ponderhit. Время обдумывания засчитывается в бюджет хода: если соперник думал
+        // дольше лимита, после ponderhit поиск сразу отдаёт лучший найденный ход.
+        std::atomic<bool> pondering{false};
+        std::shared_ptr<StopToken> stop_token; // внешняя остановка (может отсутствовать)
+        ProgressCallback on_progress;          // вызывается главным потоком после итерации
+        std::atomic<bool> stop_search_flag{false};
+        std::vector<std::unique_ptr<ThreadData>> threads;
+        std::vector<IterationInfo> iterations; // заполняет только главный поток
+        bool info_output = true;               // печатать строки info (в пакетном анализе выключено)
+        bool use_book = false;                 // ход корня сначала ищется в дебютной книге
+        bool timed_play = false;               // ранние остановки управления временем, см. continue_deepening
+    };
+
+    int num_search_threads = 1;
+    SearchOptions search_options; // копируется в контекст при старте каждого поиска
+    bool info_output_enabled = true;
+    SearchStats total_search_stats{}; // см. get_search_stats
+    std::mutex search_stats_mutex;
+
+    inline double elapsed_ms(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
 
     // --- Константы доски ---
-    const u64 PROMO_RANK_WHITE = (1ULL << 28) | (1ULL << 29) | (1ULL << 30) | (1ULL << 31);
-    const u64 PROMO_RANK_BLACK = (1ULL << 0) | (1ULL << 1) | (1ULL << 2) | (1ULL << 3);
+    constexpr u64 PROMO_RANK_WHITE = (1ULL << 28) | (1ULL << 29) | (1ULL << 30) | (1ULL << 31);
+    constexpr u64 PROMO_RANK_BLACK = (1ULL << 0) | (1ULL << 1) | (1ULL << 2) | (1ULL << 3);
 
     // =================================================================================
-    // >>>>> НОВАЯ ГЕОМЕТРИЯ ДОСКИ НА ОСНОВЕ МАССИВОВ <<<<<
+    // >>>>> ГЕОМЕТРИЯ ДОСКИ НА СДВИГАХ <<<<<
+    // Поле idx = row * 4 + col. На чётных рядах соседи по диагонали отстоят на +5/+4
+    // (вверх) и -4/-3 (вниз), на нечётных - на +4/+3 и -5/-4, поэтому сдвиг маскируется
+    // чётностью ряда и крайней колонкой. Сдвиг применяется сразу ко всему множеству полей.
     // =================================================================================
-    struct SquareInfo {
-        int neighbors[4]; // СВ, СЗ, ЮЗ, ЮВ
+    constexpr u64 BOARD_MASK = 0xFFFFFFFFULL;
+    constexpr u64 EVEN_ROWS = 0x0F0F0F0FULL;
+    constexpr u64 ODD_ROWS = 0xF0F0F0F0ULL;
+    constexpr u64 COL_LEFT = 0x11111111ULL;  // колонка 0
+    constexpr u64 COL_RIGHT = 0x88888888ULL; // колонка 3
+
+    enum Direction { DIR_NE = 0, DIR_NW = 1, DIR_SW = 2, DIR_SE = 3 }; // СВ, СЗ, ЮЗ, ЮВ
+    constexpr int opposite(int dir) { return dir ^ 2; }
+
+    inline u64 shift(u64 squares, int dir) {
+        switch (dir) {
+            case DIR_NE: return (((squares & EVEN_ROWS & ~COL_RIGHT) << 5) | ((squares & ODD_ROWS) << 4)) & BOARD_MASK;
+            case DIR_NW: return (((squares & EVEN_ROWS) << 4) | ((squares & ODD_ROWS & ~COL_LEFT) << 3)) & BOARD_MASK;
+            case DIR_SW: return ((squares & EVEN_ROWS) >> 4) | ((squares & ODD_ROWS & ~COL_LEFT) >> 5);
+            default:     return ((squares & EVEN_ROWS & ~COL_RIGHT) >> 3) | ((squares & ODD_ROWS) >> 4);
+        }
+    }
+
+    // Простые, которые могут бить в направлении dir: рядом противник, за ним пусто
+    inline u64 man_jumpers(u64 men, u64 opponents, u64 empty, int dir) {
+        int back = opposite(dir);
+        return men & shift(shift(empty, back) & opponents, back);
+    }
+
+    // Дамки, которые могут бить в направлении dir: идём назад от "противник + пусто за ним"
+    // по пустым полям, пока луч не упрётся в дамку
+    inline u64 king_jumpers(u64 kings, u64 opponents, u64 empty, int dir) {
+        int back = opposite(dir);
+        u64 ray = shift(shift(empty, back) & opponents, back);
+        u64 found = 0;
+        while (ray) {
+            found |= ray & kings;
+            ray = shift(ray & empty, back);
+        }
+        return found;
+    }
+
+    // =================================================================================
+    // >>>>> СТОРОНА НА ХОДУ КАК ПАРАМЕТР ШАБЛОНА <<<<<
+    // Генератор ходов, apply_move и поиск инстанцируются отдельно для белых (1) и чёрных (2):
+    // всё, что зависит от цвета (свои/чужие фигуры, ряд превращения, направления ходов
+    // простых, индексы Zobrist, знак оценки), - константы времени компиляции, и в горячем
+    // коде не остаётся ветвлений по цвету. Поиск переходит из negamax<1> в negamax<2> и
+    // обратно; цвет времени выполнения разбирается один раз на входе (в корне, perft, API).
+    // =================================================================================
+    template <int Color>
+    struct Side {
+        static_assert(Color == 1 || Color == 2, "цвет: 1 - белые, 2 - чёрные");
+        static constexpr int opponent = 3 - Color;
+        static constexpr u64 Bitboard::* own = Color == 1 ? &Bitboard::white_men : &Bitboard::black_men;
+        static constexpr u64 Bitboard::* other = Color == 1 ? &Bitboard::black_men : &Bitboard::white_men;
+        static constexpr u64 promo_rank = Color == 1 ? PROMO_RANK_WHITE : PROMO_RANK_BLACK;
+        static constexpr int forward_a = Color == 1 ? DIR_NE : DIR_SW; // ходы простых вперёд
+        static constexpr int forward_b = Color == 1 ? DIR_NW : DIR_SE;
+        static constexpr int man = Color - 1, king = Color + 1;        // индексы в ZOBRIST: wm=0, bm=1, wk=2, bk=3
+        static constexpr int opp_man = 2 - Color, opp_king = 4 - Color;
+        static constexpr int eval_sign = Color == 1 ? 1 : -1;          // evaluate_giveaway считает за белых
     };
 
-    SquareInfo BOARD_GEOMETRY[32];
+    // --- Прототипы внутренних функций ---
+    void find_king_jumps(MoveList& captures, u64 start_pos, u64 current_pos, u64 captured, u64 opponents, u64 empty, bool promoted);
+    template <int Color> void find_man_jumps(MoveList& captures, u64 start_pos, u64 current_pos, u64 captured, u64 opponents, u64 empty);
+    template <int Color> void generate_captures(const Bitboard& board, MoveList& captures);
+    template <int Color> void generate_quiet_moves(const Bitboard& board, MoveList& moves);
+    template <int Color> void generate_legal_moves(const Bitboard& board, MoveList& moves);
+    template <int Color> void make_move(Bitboard& b, const Move& m, UndoInfo& undo);
+    template <int Color> Bitboard apply_move(const Bitboard& b, const Move& m);
+    int evaluate_giveaway(const Bitboard& b);
+    template <int Color> int quiescence_search(ThreadData& td, Bitboard& board, SearchFrame* frame, int alpha, int beta, int ply);
+    template <int Color> int negamax(ThreadData& td, Bitboard& board, int alpha, int beta, int depth, int ply);
+
+    // --- Хранилище ТТ ---
+    void release_tt_storage() {
+        if (tt_mapping) {
+            munmap(tt_mapping, tt_mapping_size);
+            tt_mapping = nullptr;
+            tt_mapping_size = 0;
+        }
+        tt_heap_storage.reset();
+        transposition_table = nullptr;
+    }
 
-    void init_board_geometry() {
+    u64 zobrist_checksum() {
+        u64 check = ZOBRIST_BLACK_TO_MOVE;
         for (int i = 0; i < 32; ++i) {
             for (int j = 0; j < 4; ++j) {
-                BOARD_GEOMETRY[i].neighbors[j] = -1; // -1 означает нет соседа
+                check ^= (ZOBRIST[i][j] << (i % 7)) ^ ((u64)j << 60);
             }
         }
+        return check;
+    }
 
-        for (int row = 0; row < 8; ++row) {
-            for (int col = 0; col < 4; ++col) {
-                int idx = row * 4 + col;
-                
-                // СВ
-                if (row < 7 && ( (row % 2 == 0 && col < 3) || (row % 2 != 0) )) {
-                    BOARD_GEOMETRY[idx].neighbors[0] = idx + (row % 2 == 0 ? 5 : 4);
-                }
-                // СЗ
-                if (row < 7 && ( (row % 2 == 0) || (row % 2 != 0 && col > 0) )) {
-                    BOARD_GEOMETRY[idx].neighbors[1] = idx + (row % 2 == 0 ? 4 : 3);
-                }
-                // ЮЗ
-                if (row > 0 && ( (row % 2 == 0) || (row % 2 != 0 && col > 0) )) {
-                    BOARD_GEOMETRY[idx].neighbors[2] = idx - (row % 2 == 0 ? 4 : 5);
-                }
-                // ЮВ
-                if (row > 0 && ( (row % 2 == 0 && col < 3) || (row % 2 != 0) )) {
-                    BOARD_GEOMETRY[idx].neighbors[3] = idx - (row % 2 == 0 ? 3 : 4);
-                }
+    TT_FileHeader make_tt_header(size_t bucket_count) {
+        TT_FileHeader header{};
+        std::memcpy(header.magic, "KESTOGTT", 8);
+        header.version = TT_FILE_VERSION;
+        header.bucket_bytes = sizeof(TT_Bucket);
+        header.zobrist_seed = ZOBRIST_SEED;
+        header.zobrist_check = zobrist_checksum();
+        header.bucket_count = bucket_count;
+        return header;
+    }
+
+    // Отображает файл ТТ в память. Совместимый файл подхватывается как есть (тёплый старт),
+    // несовместимый или другого размера - перезаписывается пустой таблицей.
+    bool map_tt_file(const std::string& path, size_t bucket_count) {
+        size_t file_size = sizeof(TT_FileHeader) + bucket_count * sizeof(TT_Bucket);
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cerr << "TT file " << path << ": cannot open, using memory TT." << std::endl;
+            return false;
+        }
+        struct stat st;
+        bool same_size = fstat(fd, &st) == 0 && (size_t)st.st_size == file_size;
+        if (!same_size && ftruncate(fd, (off_t)file_size) != 0) {
+            close(fd);
+            std::cerr << "TT file " << path << ": cannot resize, using memory TT." << std::endl;
+            return false;
+        }
+        void* mapping = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "TT file " << path << ": mmap failed, using memory TT." << std::endl;
+            return false;
+        }
+        tt_mapping = mapping;
+        tt_mapping_size = file_size;
+        transposition_table = reinterpret_cast<TT_Bucket*>(static_cast<char*>(mapping) + sizeof(TT_FileHeader));
+        tt_mask = bucket_count - 1;
+
+        TT_FileHeader* header = static_cast<TT_FileHeader*>(mapping);
+        TT_FileHeader expected = make_tt_header(bucket_count);
+        expected.generation = header->generation;
+        if (same_size && std::memcmp(header, &expected, sizeof(TT_FileHeader)) == 0) {
+            tt_generation.store(header->generation & TT_GENERATION_MASK);
+            if (info_output_enabled) {
+                std::cout << "TT warm-loaded from " << path << "." << std::endl;
             }
+        } else {
+            clear_transposition_table();
+            *header = make_tt_header(bucket_count);
         }
+        return true;
     }
 
-    // --- Прототипы внутренних функций ---
-    void find_king_jumps(std::vector<Move>& captures, u64 start_pos, u64 current_pos, u64 captured, u64 opponents, u64 empty);
-    void find_man_jumps(std::vector<Move>& captures, u64 start_pos, u64 current_pos, u64 captured, int color, u64 my_pieces, u64 opponents, u64 empty);
-    std::vector<Move> generate_captures(const Bitboard& board, int color_to_move);
-    std::vector<Move> generate_quiet_moves(const Bitboard& board, int color_to_move);
-    int evaluate_giveaway(const Bitboard& b);
-    int quiescence_search(Bitboard& board, int alpha, int beta, int color, int ply);
-    int negamax(Bitboard& board, int alpha, int beta, int depth, int color, int ply);
+    bool save_transposition_table() {
+        if (!tt_mapping) return false;
+        static_cast<TT_FileHeader*>(tt_mapping)->generation = tt_generation.load();
+        return msync(tt_mapping, tt_mapping_size, MS_SYNC) == 0;
+    }
 
     // --- Инициализация ---
-    void init_engine(int tt_size_mb) {
-        init_board_geometry(); // Инициализируем нашу карту доски
-        std::mt19937_64 rng(0xdeadbeef);
+    void init_engine(int tt_size_mb, int num_threads, const std::string& tt_path, const std::string& nnue_path) {
+        std::mt19937_64 rng(ZOBRIST_SEED);
         for (int i = 0; i < 32; ++i) {
             for (int j = 0; j < 4; ++j) {
                 ZOBRIST[i][j] = rng();
@@ -98,14 +366,187 @@ namespace kestog_core {
         }
         ZOBRIST_BLACK_TO_MOVE = rng();
 
-        size_t tt_size = (size_t)tt_size_mb * 1024 * 1024 / sizeof(TT_Entry);
+        size_t tt_size = (size_t)tt_size_mb * 1024 * 1024 / sizeof(TT_Bucket);
         size_t power_of_2_size = 1;
         while (power_of_2_size * 2 <= tt_size && power_of_2_size != 0) {
             power_of_2_size *= 2;
         }
-        transposition_table.assign(power_of_2_size, TT_Entry());
-        tt_mask = power_of_2_size - 1;
-        std::cout << "TT initialized with " << power_of_2_size << " entries (" << tt_size_mb << "MB)." << std::endl;
+        release_tt_storage();
+        if (tt_path.empty() || !map_tt_file(tt_path, power_of_2_size)) {
+            tt_heap_storage.reset(new TT_Bucket[power_of_2_size]);
+            transposition_table = tt_heap_storage.get();
+            tt_mask = power_of_2_size - 1;
+            clear_transposition_table();
+        }
+        num_search_threads = std::max(1, num_threads);
+        if (info_output_enabled) {
+            std::cout << "TT initialized with " << power_of_2_size * TT_BUCKET_SIZE << " entries (" << tt_size_mb << "MB), "
+                      << num_search_threads << " search thread(s)." << std::endl;
+        }
+        if (!nnue_load(nnue_path) && !nnue_path.empty() && info_output_enabled) {
+            std::cout << "NNUE weights not loaded from " << nnue_path << ", using the built-in evaluation." << std::endl;
+        }
+    }
+
+    void clear_transposition_table() {
+        for (size_t i = 0; i <= tt_mask; ++i) {
+            for (auto& slot : transposition_table[i].slots) {
+                slot.key.store(0, std::memory_order_relaxed);
+                slot.data.store(0, std::memory_order_relaxed);
+            }
+        }
+        tt_generation.store(0);
+    }
+
+    void set_info_output(bool enabled) {
+        info_output_enabled = enabled;
+    }
+
+    bool search_stats_enabled() {
+#ifdef KESTOG_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void add_search_stats(SearchStats& total, const SearchStats& s) {
+        total.nodes += s.nodes;
+        total.qnodes += s.qnodes;
+        total.tt_probes += s.tt_probes;
+        total.tt_hits += s.tt_hits;
+        total.tt_cutoffs_exact += s.tt_cutoffs_exact;
+        total.tt_cutoffs_alpha += s.tt_cutoffs_alpha;
+        total.tt_cutoffs_beta += s.tt_cutoffs_beta;
+        total.beta_cutoffs += s.beta_cutoffs;
+        for (int i = 0; i < STATS_CUTOFF_BUCKETS; ++i) total.beta_cutoff_index[i] += s.beta_cutoff_index[i];
+        total.capture_moves += s.capture_moves;
+        total.capture_chain_pieces += s.capture_chain_pieces;
+        total.king_capture_moves += s.king_capture_moves;
+        total.king_chain_pieces += s.king_chain_pieces;
+        total.movegen_ns += s.movegen_ns;
+        total.eval_ns += s.eval_ns;
+    }
+
+    SearchStats get_search_stats() {
+        std::lock_guard<std::mutex> lock(search_stats_mutex);
+        return total_search_stats;
+    }
+
+    void reset_search_stats() {
+        std::lock_guard<std::mutex> lock(search_stats_mutex);
+        total_search_stats = SearchStats{};
+    }
+
+    void set_search_options(const SearchOptions& options) {
+        search_options = options;
+        search_options.aspiration_window = std::max(1, search_options.aspiration_window);
+        search_options.lmr_min_depth = std::max(2, search_options.lmr_min_depth);
+        search_options.lmr_full_moves = std::max(1, search_options.lmr_full_moves);
+    }
+
+    SearchOptions get_search_options() {
+        return search_options;
+    }
+
+    // --- Упаковка записей ТТ ---
+    // data: [0..15] ход, [16..31] оценка (int16), [32..39] глубина, [40..41] флаг, [42..47] поколение
+    // ход:  [0..4] откуда, [5..9] куда, [10] превращение, [15] ход есть.
+    // Взятые фигуры не храним: ход из ТТ служит только для упорядочивания и сверяется по from/to.
+    inline u64 pack_tt_data(const Move& m, int score, int depth, TT_FLAG flag, int generation) {
+        u64 move16 = 0;
+        if (m.mask_from) {
+            move16 = (u64)(bitscan_forward(m.mask_from) - 1)
+                   | ((u64)(bitscan_forward(m.mask_to) - 1) << 5)
+                   | ((u64)m.becomes_king << 10)
+                   | (1ULL << 15);
+        }
+        return move16
+             | ((u64)(uint16_t)(int16_t)score << 16)
+             | ((u64)(uint8_t)std::min(std::max(depth, 0), 255) << 32)
+             | ((u64)flag << 40)
+             | ((u64)(generation & TT_GENERATION_MASK) << 42);
+    }
+
+    inline Move unpack_tt_move(u64 data) {
+        if (!(data & (1ULL << 15))) return Move{};
+        return {1ULL << (data & 31), 1ULL << ((data >> 5) & 31), 0, ((data >> 10) & 1) != 0, 0};
+    }
+    inline int tt_data_depth(u64 data) { return (int)((data >> 32) & 0xFF); }
+    inline int tt_data_generation(u64 data) { return (int)((data >> 42) & TT_GENERATION_MASK); }
+
+    inline TT_Bucket& tt_bucket(u64 hash) {
+        return transposition_table[hash & tt_mask];
+    }
+
+    inline void tt_prefetch(u64 hash) {
+        __builtin_prefetch(&tt_bucket(hash));
+    }
+
+    // Новый поиск: записи прошлых поисков становятся "старыми" и вытесняются первыми
+    // (рабочие пакетного анализа вызывают её одновременно, поэтому сдвиг атомарный)
+    void tt_new_search() {
+        uint8_t generation = tt_generation.load();
+        while (!tt_generation.compare_exchange_weak(generation, (uint8_t)((generation + 1) & TT_GENERATION_MASK))) {}
+    }
+
+    bool tt_probe(u64 hash, TT_Entry& out) {
+        TT_Bucket& bucket = tt_bucket(hash);
+        for (auto& slot : bucket.slots) {
+            u64 key = slot.key.load(std::memory_order_relaxed);
+            u64 data = slot.data.load(std::memory_order_relaxed);
+            if ((key ^ data) != hash || !data) continue;
+            out.score = (int16_t)(uint16_t)((data >> 16) & 0xFFFF);
+            out.depth = tt_data_depth(data);
+            out.flag = (TT_FLAG)((data >> 40) & 3);
+            out.best_move = unpack_tt_move(data);
+            return true;
+        }
+        return false;
+    }
+
+    // Замещение: своя же позиция перезаписывается всегда (ход сохраняем, если новый не известен);
+    // иначе вытесняем запись с наименьшей ценностью "глубина - 4 * возраст в поисках".
+    void tt_store(u64 hash, int score, int depth, TT_FLAG flag, const Move& best_move) {
+        TT_Bucket& bucket = tt_bucket(hash);
+        int generation = tt_generation.load(std::memory_order_relaxed);
+        TT_Slot* victim = nullptr;
+        int victim_value = 1 << 30;
+        for (auto& slot : bucket.slots) {
+            u64 key = slot.key.load(std::memory_order_relaxed);
+            u64 data = slot.data.load(std::memory_order_relaxed);
+            if (!data || (key ^ data) == hash) {
+                victim = &slot;
+                break;
+            }
+            int age = (generation - tt_data_generation(data)) & TT_GENERATION_MASK;
+            int value = tt_data_depth(data) - 4 * age;
+            if (value < victim_value) {
+                victim_value = value;
+                victim = &slot;
+            }
+        }
+        u64 data = pack_tt_data(best_move, score, depth, flag, generation);
+        if (!best_move.mask_from) {
+            u64 old_data = victim->data.load(std::memory_order_relaxed);
+            if ((victim->key.load(std::memory_order_relaxed) ^ old_data) == hash) data |= old_data & 0xFFFF;
+        }
+        victim->key.store(hash ^ data, std::memory_order_relaxed);
+        victim->data.store(data, std::memory_order_relaxed);
+    }
+
+    // Заполненность ТТ в промилле по записям текущего поколения (по первым 1000 корзинам)
+    int tt_hashfull() {
+        size_t buckets = std::min<size_t>(1000, tt_mask + 1);
+        int generation = tt_generation.load(std::memory_order_relaxed);
+        size_t used = 0;
+        for (size_t i = 0; i < buckets; ++i) {
+            for (const auto& slot : transposition_table[i].slots) {
+                u64 data = slot.data.load(std::memory_order_relaxed);
+                if (data && tt_data_generation(data) == generation) ++used;
+            }
+        }
+        return (int)(used * 1000 / (buckets * TT_BUCKET_SIZE));
     }
 
     u64 calculate_hash(const Bitboard& board, int color_to_move) {
@@ -130,169 +571,199 @@ namespace kestog_core {
 
     // --- Генерация ходов ---
 
-    void find_king_jumps(std::vector<Move>& captures, u64 start_pos, u64 current_pos, u64 captured, u64 opponents, u64 empty) {
-        bool can_jump_further = false;
-        int from_idx = bitscan_forward(current_pos) - 1;
+    // Законченная цепочка взятия. Разрешены только взятия максимальной длины, поэтому
+    // в списке держим лишь самые длинные из найденных: короткие цепочки не занимают
+    // место (их может быть больше MAX_MOVES), а более длинная вытесняет весь список.
+    // Список должен содержать только взятия.
+    inline void push_capture(MoveList& captures, const Move& m) {
+        if (!captures.empty()) {
+            int best = popcount(captures[0].captured_pieces);
+            int length = popcount(m.captured_pieces);
+            if (length < best) return;
+            if (length > best) captures.clear();
+        }
+        captures.push_back(m);
+    }
 
-        for (int i = 0; i < 4; ++i) { // 4 направления
-            int path_idx = from_idx;
-            int jumped_idx = -1;
+    // promoted - цепочку начала простая, дошедшая до последнего ряда: ход заканчивается превращением
+    void find_king_jumps(MoveList& captures, u64 start_pos, u64 current_pos, u64 captured, u64 opponents, u64 empty, bool promoted) {
+        bool can_jump_further = false;
 
+        for (int dir = 0; dir < 4; ++dir) {
             // Летим по пустым полям в поисках первой фигуры
-            while(true) {
-                path_idx = BOARD_GEOMETRY[path_idx].neighbors[i];
-                if (path_idx == -1) break; // Уперлись в край доски
-                if ((1ULL << path_idx) & opponents) {
-                    jumped_idx = path_idx;
-                    break;
-                }
-                if (!((1ULL << path_idx) & empty)) break; // Уперлись в свою фигуру
-            }
-
-            if (jumped_idx != -1 && !(captured & (1ULL << jumped_idx))) {
-                u64 jumped_pos = 1ULL << jumped_idx;
-                int land_idx = BOARD_GEOMETRY[jumped_idx].neighbors[i];
-                if (land_idx != -1 && ((1ULL << land_idx) & empty)) {
-                     for (int current_land_idx = land_idx; current_land_idx != -1; current_land_idx = BOARD_GEOMETRY[current_land_idx].neighbors[i]) {
-                        u64 land_pos = 1ULL << current_land_idx;
-                        if (!(land_pos & empty)) break;
-                        can_jump_further = true;
-                        u64 new_captured = captured | jumped_pos;
-                        u64 new_opponents = opponents & ~jumped_pos;
-                        u64 new_empty = (empty | current_pos | jumped_pos) & ~land_pos;
-                        find_king_jumps(captures, start_pos, land_pos, new_captured, new_opponents, new_empty);
-                    }
-                }
+            u64 jumped_pos = shift(current_pos, dir);
+            while (jumped_pos & empty) jumped_pos = shift(jumped_pos, dir);
+            if (!(jumped_pos & opponents) || (captured & jumped_pos)) continue;
+
+            for (u64 land_pos = shift(jumped_pos, dir); land_pos & empty; land_pos = shift(land_pos, dir)) {
+                can_jump_further = true;
+                u64 new_captured = captured | jumped_pos;
+                u64 new_opponents = opponents & ~jumped_pos;
+                u64 new_empty = (empty | current_pos | jumped_pos) & ~land_pos;
+                find_king_jumps(captures, start_pos, land_pos, new_captured, new_opponents, new_empty, promoted);
             }
         }
 
         if (!can_jump_further && captured > 0) {
-            captures.push_back({start_pos, current_pos, captured, false, 0});
+            push_capture(captures, {start_pos, current_pos, captured, promoted, 0});
         }
     }
 
-    void find_man_jumps(std::vector<Move>& captures, u64 start_pos, u64 current_pos, u64 captured, int color, u64 my_pieces, u64 opponents, u64 empty) {
+    template <int Color>
+    void find_man_jumps(MoveList& captures, u64 start_pos, u64 current_pos, u64 captured, u64 opponents, u64 empty) {
         bool can_jump_further = false;
-        u64 promo_rank = (color == 1) ? PROMO_RANK_WHITE : PROMO_RANK_BLACK;
-        int from_idx = bitscan_forward(current_pos) - 1;
 
-        for (int i = 0; i < 4; ++i) { // 4 направления
-            int jumped_idx = BOARD_GEOMETRY[from_idx].neighbors[i];
-            if (jumped_idx == -1) continue;
-
-            int land_idx = BOARD_GEOMETRY[jumped_idx].neighbors[i];
-            if (land_idx == -1) continue;
-
-            u64 jumped_pos = 1ULL << jumped_idx;
-            u64 land_pos = 1ULL << land_idx;
+        for (int dir = 0; dir < 4; ++dir) {
+            u64 jumped_pos = shift(current_pos, dir);
+            u64 land_pos = shift(jumped_pos, dir);
 
             if ((jumped_pos & opponents) && !(captured & jumped_pos) && (land_pos & empty)) {
                 can_jump_further = true;
                 u64 new_captured = captured | jumped_pos;
-                u64 new_my_pieces = (my_pieces & ~current_pos) | land_pos;
                 u64 new_opponents = opponents & ~jumped_pos;
                 u64 new_empty = (empty | current_pos | jumped_pos) & ~land_pos;
-                if (land_pos & promo_rank) {
-                    find_king_jumps(captures, start_pos, land_pos, new_captured, new_opponents, new_empty);
+                if (land_pos & Side<Color>::promo_rank) {
+                    // Простая, дошедшая до последнего ряда, бьёт дальше уже дамкой
+                    // и остаётся дамкой, где бы взятие ни закончилось
+                    find_king_jumps(captures, start_pos, land_pos, new_captured, new_opponents, new_empty, true);
                 } else {
-                    find_man_jumps(captures, start_pos, land_pos, new_captured, color, new_my_pieces, new_opponents, new_empty);
+                    find_man_jumps<Color>(captures, start_pos, land_pos, new_captured, new_opponents, new_empty);
                 }
             }
         }
 
         if (!can_jump_further && captured > 0) {
-            bool becomes_king = (current_pos & promo_rank) != 0;
-            captures.push_back({start_pos, current_pos, captured, becomes_king, 0});
+            bool becomes_king = (current_pos & Side<Color>::promo_rank) != 0;
+            push_capture(captures, {start_pos, current_pos, captured, becomes_king, 0});
         }
     }
 
-    std::vector<Move> generate_captures(const Bitboard& board, int color_to_move) {
-        std::vector<Move> captures;
-        u64 my_pieces = (color_to_move == 1) ? board.white_men : board.black_men;
-        u64 opponents = (color_to_move == 1) ? board.black_men : board.white_men;
-        u64 empty = ~(my_pieces | opponents);
-        
+    // Фигуры стороны Color, у которых есть хотя бы одно взятие (все направления разом)
+    template <int Color>
+    inline void find_capturers(const Bitboard& board, u64& men_out, u64& kings_out) {
+        u64 my_pieces = board.*Side<Color>::own;
+        u64 opponents = board.*Side<Color>::other;
+        u64 empty = ~(my_pieces | opponents) & BOARD_MASK;
         u64 men = my_pieces & ~board.kings;
-        while(men) { 
-            u64 p = 1ULL << (bitscan_forward(men)-1); 
-            find_man_jumps(captures, p, p, 0, color_to_move, my_pieces, opponents, empty); 
-            men &= men-1; 
-        }
-        
         u64 kings = my_pieces & board.kings;
-        while(kings) { 
-            u64 p = 1ULL << (bitscan_forward(kings)-1); 
-            find_king_jumps(captures, p, p, 0, opponents, empty); 
-            kings &= kings-1; 
+        men_out = kings_out = 0;
+        for (int dir = 0; dir < 4; ++dir) {
+            men_out |= man_jumpers(men, opponents, empty, dir);
+            if (kings) kings_out |= king_jumpers(kings, opponents, empty, dir);
+        }
+    }
+
+    template <int Color>
+    void generate_captures(const Bitboard& board, MoveList& captures) {
+        u64 men, kings;
+        find_capturers<Color>(board, men, kings);
+        if (!(men | kings)) return;
+
+        // Цепочки взятий раскрываем по одной фигуре, и только для тех, кто действительно бьёт
+        u64 opponents = board.*Side<Color>::other;
+        u64 empty = ~(board.white_men | board.black_men) & BOARD_MASK;
+        for (; men; men &= men - 1) {
+            u64 p = men & (~men + 1);
+            find_man_jumps<Color>(captures, p, p, 0, opponents, empty);
+        }
+        for (; kings; kings &= kings - 1) {
+            u64 p = kings & (~kings + 1);
+            find_king_jumps(captures, p, p, 0, opponents, empty, false);
         }
-        return captures;
     }
 
-    std::vector<Move> generate_quiet_moves(const Bitboard& board, int color_to_move) {
-        std::vector<Move> moves;
-        const u64 empty = ~(board.white_men | board.black_men);
-        u64 my_pieces = (color_to_move == 1) ? board.white_men : board.black_men;
+    template <int Color>
+    void generate_quiet_moves(const Bitboard& board, MoveList& moves) {
+        constexpr int dir_a = Side<Color>::forward_a;
+        constexpr int dir_b = Side<Color>::forward_b;
+        constexpr u64 promo_rank = Side<Color>::promo_rank;
+        const u64 empty = ~(board.white_men | board.black_men) & BOARD_MASK;
+        u64 my_pieces = board.*Side<Color>::own;
         u64 my_men = my_pieces & ~board.kings;
 
-        u64 temp_men = my_men;
-        while (temp_men) {
-            u64 p = 1ULL << (bitscan_forward(temp_men) - 1);
-            int from_idx = bitscan_forward(p) - 1;
-
-            int start_dir = (color_to_move == 1) ? 0 : 2;
-            int end_dir = (color_to_move == 1) ? 2 : 4;
-
-            // 1. Обычные тихие ходы
-            for (int i = start_dir; i < end_dir; ++i) {
-                int to_idx = BOARD_GEOMETRY[from_idx].neighbors[i];
-                if (to_idx != -1) {
-                    u64 t = 1ULL << to_idx;
-                    if (t & empty) {
-                        moves.push_back({p, t, 0, (t & (color_to_move == 1 ? PROMO_RANK_WHITE : PROMO_RANK_BLACK)) != 0, 0});
-                    }
-                }
+        // 1. Обычные тихие ходы: подвижные простые по обоим направлениям вперёд разом
+        u64 movers_a = my_men & shift(empty, opposite(dir_a));
+        u64 movers_b = my_men & shift(empty, opposite(dir_b));
+        for (u64 movers = movers_a | movers_b; movers; movers &= movers - 1) {
+            u64 p = movers & (~movers + 1);
+            if (p & movers_a) {
+                u64 t = shift(p, dir_a);
+                moves.push_back({p, t, 0, (t & promo_rank) != 0, 0});
+            }
+            if (p & movers_b) {
+                u64 t = shift(p, dir_b);
+                moves.push_back({p, t, 0, (t & promo_rank) != 0, 0});
             }
-            temp_men &= temp_men - 1;
         }
 
         // 2. Ходы дамок
-        u64 kings = my_pieces & ~my_men;
-        while(kings) {
-            u64 p = 1ULL << (bitscan_forward(kings) - 1);
-            int from_idx = bitscan_forward(p) - 1;
-            for (int i = 0; i < 4; ++i) {
-                for (int current_idx = from_idx; ; ) {
-                    current_idx = BOARD_GEOMETRY[current_idx].neighbors[i];
-                    if (current_idx == -1) break;
-                    u64 t = 1ULL << current_idx;
-                    if (t & empty) {
-                        moves.push_back({p, t, 0, false, 0});
-                    } else {
-                        break;
-                    }
+        for (u64 kings = my_pieces & ~my_men; kings; kings &= kings - 1) {
+            u64 p = kings & (~kings + 1);
+            for (int dir = 0; dir < 4; ++dir) {
+                for (u64 t = shift(p, dir); t & empty; t = shift(t, dir)) {
+                    moves.push_back({p, t, 0, false, 0});
                 }
             }
-            kings &= kings - 1;
         }
-        return moves;
+    }
+
+    // Взятие обязательно, и из взятий разрешены только максимальные по числу фигур:
+    // generate_captures уже оставляет только их (см. push_capture).
+    template <int Color>
+    void generate_legal_moves(const Bitboard& board, MoveList& moves) {
+        moves.clear();
+        generate_captures<Color>(board, moves);
+        if (!moves.empty()) return;
+        generate_quiet_moves<Color>(board, moves);
+    }
+
+    void generate_legal_moves(const Bitboard& board, int color_to_move, MoveList& moves) {
+        if (color_to_move == 1) generate_legal_moves<1>(board, moves);
+        else generate_legal_moves<2>(board, moves);
     }
 
     std::vector<Move> generate_legal_moves(const Bitboard& board, int color_to_move) {
-        auto captures = generate_captures(board, color_to_move);
-        if (!captures.empty()) {
-            int max_captured = 0;
-            for (const auto& m : captures) {
-                max_captured = std::max(max_captured, (int)popcount(m.captured_pieces));
-            }
-            std::vector<Move> max_captures;
-            for (const auto& m : captures) {
-                if (popcount(m.captured_pieces) == max_captured) {
-                    max_captures.push_back(m);
-                }
-            }
-            return max_captures;
+        MoveList moves;
+        generate_legal_moves(board, color_to_move, moves);
+        return std::vector<Move>(moves.begin(), moves.end());
+    }
+
+    // --- Perft ---
+    template <int Color>
+    long long perft_recursive(const Bitboard& board, int depth) {
+        MoveList moves;
+        generate_legal_moves<Color>(board, moves);
+        if (depth == 1) return moves.size(); // на последнем уровне листья просто пересчитываем
+        long long nodes = 0;
+        for (const auto& move : moves) {
+            nodes += perft_recursive<Side<Color>::opponent>(apply_move<Color>(board, move), depth - 1);
+        }
+        return nodes;
+    }
+
+    long long perft_recursive(const Bitboard& board, int color, int depth) {
+        return color == 1 ? perft_recursive<1>(board, depth) : perft_recursive<2>(board, depth);
+    }
+
+    long long perft(const Bitboard& board, int color_to_move, int depth) {
+        if (depth <= 0) return 1;
+        Bitboard root = board;
+        root.hash = calculate_hash(board, color_to_move);
+        return perft_recursive(root, color_to_move, depth);
+    }
+
+    std::vector<std::pair<Move, long long>> perft_divide(const Bitboard& board, int color_to_move, int depth) {
+        std::vector<std::pair<Move, long long>> result;
+        if (depth <= 0) return result;
+        Bitboard root = board;
+        root.hash = calculate_hash(board, color_to_move);
+        MoveList moves;
+        generate_legal_moves(root, color_to_move, moves);
+        for (const auto& move : moves) {
+            Bitboard next = apply_move(root, move, color_to_move);
+            result.emplace_back(move, depth == 1 ? 1 : perft_recursive(next, 3 - color_to_move, depth - 1));
         }
-        return generate_quiet_moves(board, color_to_move);
+        return result;
     }
 
     // --- Остальной код без изменений ---
@@ -311,151 +782,796 @@ namespace kestog_core {
         }
         return (black_material - white_material) + (black_pos - white_pos);
     }
-    Bitboard apply_move(const Bitboard& b, const Move& m, int c) {
-        Bitboard next_b = b;
-        u64 from_to = m.mask_from | m.mask_to;
+    // Ход на месте: снимаем фигуру с from, ставим на to (с учётом превращения), снимаем
+    // взятые фигуры и меняем очередь хода. Хеш обновляется инкрементально, поэтому b.hash
+    // должен соответствовать позиции b со стороной Color на ходу. В undo остаётся всё,
+    // чтобы unmake_move вернул доску без копирования.
+    template <int Color>
+    inline void make_move(Bitboard& b, const Move& m, UndoInfo& undo) {
+        // XOR, а не OR: при круговом взятии (from == to) фигура остаётся на месте
+        u64 from_to = m.mask_from ^ m.mask_to;
         bool is_king_before_move = (b.kings & m.mask_from) != 0;
-        if (c == 1) {
-            next_b.white_men ^= from_to;
-            if (m.captured_pieces) next_b.black_men &= ~m.captured_pieces;
-        } else {
-            next_b.black_men ^= from_to;
-            if (m.captured_pieces) next_b.white_men &= ~m.captured_pieces;
+        int from_idx = bitscan_forward(m.mask_from) - 1;
+        int to_idx = bitscan_forward(m.mask_to) - 1;
+        constexpr int my_man = Side<Color>::man, my_king = Side<Color>::king;
+        constexpr int opp_man = Side<Color>::opp_man, opp_king = Side<Color>::opp_king;
+        u64 delta = ZOBRIST_BLACK_TO_MOVE;
+        undo.from_to = from_to;
+        undo.captured = m.captured_pieces;
+        undo.kings = b.kings;
+        b.*Side<Color>::own ^= from_to;
+        // Взятые снимаем до переноса своей фигуры: дамка может закончить взятие
+        // на поле уже снятой фигуры, и её признак дамки не должен пропасть
+        if (m.captured_pieces) {
+            b.*Side<Color>::other &= ~m.captured_pieces;
+            b.kings &= ~m.captured_pieces;
         }
         if (is_king_before_move) {
-            next_b.kings ^= from_to;
+            b.kings ^= from_to;
+            delta ^= ZOBRIST[from_idx][my_king] ^ ZOBRIST[to_idx][my_king];
         } else if (m.becomes_king) {
-            next_b.kings |= m.mask_to;
+            b.kings |= m.mask_to;
+            delta ^= ZOBRIST[from_idx][my_man] ^ ZOBRIST[to_idx][my_king];
+        } else {
+            delta ^= ZOBRIST[from_idx][my_man] ^ ZOBRIST[to_idx][my_man];
         }
-        if (m.captured_pieces) {
-            next_b.kings &= ~m.captured_pieces;
+        for (u64 captured = m.captured_pieces; captured; captured &= captured - 1) {
+            int idx = bitscan_forward(captured) - 1;
+            delta ^= ZOBRIST[idx][(undo.kings >> idx) & 1 ? opp_king : opp_man];
         }
-        next_b.hash = calculate_hash(next_b, 3 - c);
+        b.hash ^= delta;
+        undo.hash_delta = delta;
+    }
+
+    template <int Color>
+    inline void unmake_move(Bitboard& b, const UndoInfo& undo) {
+        b.*Side<Color>::own ^= undo.from_to;
+        b.*Side<Color>::other |= undo.captured;
+        b.kings = undo.kings;
+        b.hash ^= undo.hash_delta;
+    }
+
+    // Ход на доске поиска: вместе с make_move строит аккумулятор NNUE следующего
+    // полухода в frame[1], пока доска ещё в позиции до хода
+    template <int Color>
+    inline void make_move(Bitboard& b, const Move& m, SearchFrame* frame) {
+        if (nnue_active) nnue_apply_move(frame[0].accumulator, frame[1].accumulator, b, m, Color);
+        make_move<Color>(b, m, frame[0].undo);
+    }
+
+    template <int Color>
+    Bitboard apply_move(const Bitboard& b, const Move& m) {
+        Bitboard next_b = b;
+        UndoInfo undo;
+        make_move<Color>(next_b, m, undo);
+        // Отладочная сверка с полным пересчётом. Сравниваем приращения, а не сами хеши,
+        // чтобы проверка работала и для досок, пришедших из Python без хеша.
+        assert((next_b.hash ^ b.hash) == (calculate_hash(next_b, Side<Color>::opponent) ^ calculate_hash(b, Color)));
         return next_b;
     }
-    void score_moves(std::vector<Move>& moves, const Move& tt_move, int ply) {
+
+    Bitboard apply_move(const Bitboard& b, const Move& m, int c) {
+        return c == 1 ? apply_move<1>(b, m) : apply_move<2>(b, m);
+    }
+    void score_moves(ThreadData& td, MoveList& moves, const Move& tt_move, int ply) {
         for (auto& move : moves) {
             if (move.mask_from == tt_move.mask_from && move.mask_to == tt_move.mask_to) {
                 move.score = 100000;
             } else if (move.captured_pieces > 0) {
                 move.score = 90000 + popcount(move.captured_pieces);
-            } else if ((move.mask_from == killer_moves[ply][0].mask_from && move.mask_to == killer_moves[ply][0].mask_to) ||
-                       (move.mask_from == killer_moves[ply][1].mask_from && move.mask_to == killer_moves[ply][1].mask_to)) {
+            } else if ((move.mask_from == td.killer_moves[ply][0].mask_from && move.mask_to == td.killer_moves[ply][0].mask_to) ||
+                       (move.mask_from == td.killer_moves[ply][1].mask_from && move.mask_to == td.killer_moves[ply][1].mask_to)) {
                 move.score = 80000;
             } else {
-                move.score = history[bitscan_forward(move.mask_from)-1][bitscan_forward(move.mask_to)-1];
+                move.score = td.history[bitscan_forward(move.mask_from)-1][bitscan_forward(move.mask_to)-1];
             }
         }
         std::sort(moves.begin(), moves.end(), [](const Move& a, const Move& b) {
             return a.score > b.score;
         });
     }
-    int negamax(Bitboard& board, int alpha, int beta, int depth, int color, int ply) {
-        nodes_searched++;
-        if ((nodes_searched & 2047) == 0) {
-            auto now = std::chrono::steady_clock::now();
-            if (std::chrono::duration_cast<std::chrono::milliseconds>(now - search_start_time).count() > time_limit_ms) {
-                stop_search_flag = true;
+    inline bool same_move(const Move& a, const Move& b) {
+        return a.mask_from == b.mask_from && a.mask_to == b.mask_to && a.captured_pieces == b.captured_pieces;
+    }
+
+    // Убирает из списка ходы корня, уже занявшие строки MultiPV в этой итерации
+    void remove_excluded_root_moves(const ThreadData& td, MoveList& moves) {
+        int kept = 0;
+        for (int i = 0; i < moves.size(); ++i) {
+            bool excluded = false;
+            for (int j = 0; j < td.root_excluded_count; ++j) excluded = excluded || same_move(moves[i], td.root_excluded[j]);
+            if (!excluded) moves[kept++] = moves[i];
+        }
+        moves.count = kept;
+    }
+
+#ifdef KESTOG_STATS
+    // Длины цепочек в списке ходов поиска. Взятие обязательно, поэтому если первый
+    // ход не взятие, взятий в списке нет
+    void count_capture_chains(SearchStats& stats, const Bitboard& board, const MoveList& moves) {
+        for (const auto& m : moves) {
+            if (!m.captured_pieces) return;
+            int length = popcount(m.captured_pieces);
+            stats.capture_moves++;
+            stats.capture_chain_pieces += length;
+            if (board.kings & m.mask_from) {
+                stats.king_capture_moves++;
+                stats.king_chain_pieces += length;
             }
         }
-        if (stop_search_flag || ply >= MAX_PLY) return 0;
-        TT_Entry& tt_entry = transposition_table[board.hash & tt_mask];
-        if (tt_entry.hash_lock == board.hash && tt_entry.depth >= depth) {
-            if (tt_entry.flag == TT_EXACT) return tt_entry.score;
-            if (tt_entry.flag == TT_ALPHA && tt_entry.score <= alpha) return alpha;
-            if (tt_entry.flag == TT_BETA && tt_entry.score >= beta) return beta;
+    }
+#endif
+
+    template <int Color>
+    int negamax(ThreadData& td, Bitboard& board, int alpha, int beta, int depth, int ply) {
+        constexpr int Opp = Side<Color>::opponent;
+        SearchContext& ctx = *td.ctx;
+        td.nodes++;
+        td.pv_length[ply] = ply;
+        if (td.id == 0 && (td.nodes & 2047) == 0) {
+            bool out_of_time = !ctx.pondering.load(std::memory_order_acquire) &&
+                               elapsed_ms(ctx.search_start_time) >= ctx.time_limit_ms;
+            if (out_of_time || (ctx.stop_token && ctx.stop_token->stop_requested())) {
+                ctx.stop_search_flag.store(true, std::memory_order_relaxed);
+            }
+        }
+        // Лимит узлов проверяем в каждом узле: поиск на фиксированное число узлов
+        // (самоигра) должен останавливаться в одном и том же месте
+        if (td.id == 0 && ctx.options.node_limit && td.nodes >= ctx.options.node_limit) {
+            ctx.stop_search_flag.store(true, std::memory_order_relaxed);
+        }
+        if (ctx.stop_search_flag.load(std::memory_order_relaxed) || ply >= MAX_PLY) return 0;
+        TT_Entry tt_entry{};
+        bool tt_hit = tt_probe(board.hash, tt_entry);
+        td.tt_probes++;
+        td.tt_hits += tt_hit;
+        // В корне не отсекаемся по ТТ: лучший ход корня каждый поток хранит сам
+        if (tt_hit && ply > 0 && tt_entry.depth >= depth) {
+            if (tt_entry.flag == TT_EXACT) {
+                STAT(td.stats.tt_cutoffs_exact++);
+                return tt_entry.score;
+            }
+            if (tt_entry.flag == TT_ALPHA && tt_entry.score <= alpha) {
+                STAT(td.stats.tt_cutoffs_alpha++);
+                return alpha;
+            }
+            if (tt_entry.flag == TT_BETA && tt_entry.score >= beta) {
+                STAT(td.stats.tt_cutoffs_beta++);
+                return beta;
+            }
+        }
+        // Эндшпильные таблицы: точный исход вместо дальнейшего перебора
+        if (ply > 0 && (int)popcount(board.white_men | board.black_men) <= tb_max_pieces()) {
+            int wdl = tb_probe(board, Color);
+            if (wdl != TB_UNKNOWN) {
+                td.tb_hits++;
+                if (wdl == TB_WIN) return TB_WIN_SCORE - ply;
+                if (wdl == TB_LOSS) return -(TB_WIN_SCORE - ply);
+                return 0;
+            }
         }
         if (depth <= 0) {
-            return quiescence_search(board, alpha, beta, color, 0);
+            return quiescence_search<Color>(td, board, &td.frames[ply], alpha, beta, 0);
         }
-        auto moves = generate_legal_moves(board, color);
+        MoveList& moves = td.frames[ply].moves;
+        STAT_TIMED(td.stats.movegen_ns, generate_legal_moves<Color>(board, moves));
+        STAT(count_capture_chains(td.stats, board, moves));
         if (moves.empty()) {
             return MATE_SCORE - ply;
         }
-        score_moves(moves, tt_entry.best_move, ply);
+        if (ply == 0 && td.root_excluded_count) remove_excluded_root_moves(td, moves);
+        score_moves(td, moves, tt_entry.best_move, ply);
         int best_score = -INFINITY_SCORE;
         Move best_move = moves[0];
         TT_FLAG flag = TT_ALPHA;
-        for (const auto& move : moves) {
-            Bitboard next_board = apply_move(board, move, color);
-            if ((color == 1 && next_board.white_men == 0) || (color == 2 && next_board.black_men == 0)) {
-                return MATE_SCORE - ply;
+        const SearchOptions& options = ctx.options;
+        for (int i = 0; i < moves.size(); ++i) {
+            const Move& move = moves[i];
+            int score;
+            if (move.captured_pieces == board.*Side<Color>::other) {
+                // Взятие всех оставшихся фигур соперника: ему нечем ходить, и в поддавках
+                // он выиграл. Видно по маске взятия, ход не делаем и ниже не спускаемся
+                score = -(MATE_SCORE - (ply + 1));
+                td.pv_length[ply + 1] = ply + 1;
+            } else {
+                make_move<Color>(board, move, &td.frames[ply]);
+                tt_prefetch(board.hash);
+                // LMR: тихие ходы в хвосте списка (ниже киллеров по score_moves) сначала
+                // смотрим на меньшую глубину; ход, поднявший alpha, перепроверяется полностью
+                int reduction = 0;
+                if (options.lmr && depth >= options.lmr_min_depth && i >= options.lmr_full_moves &&
+                    move.captured_pieces == 0 && !move.becomes_king && move.score < 80000) {
+                    reduction = (depth >= 6 && i >= 2 * options.lmr_full_moves) ? 2 : 1;
+                }
+                if ((i == 0 || !options.pvs) && !reduction) {
+                    score = -negamax<Opp>(td, board, -beta, -alpha, depth - 1, ply + 1);
+                } else {
+                    // PVS: после первого хода достаточно доказать, что ход не лучше alpha (нулевое окно)
+                    int lower = options.pvs ? -alpha - 1 : -beta;
+                    score = -negamax<Opp>(td, board, lower, -alpha, depth - 1 - reduction, ply + 1);
+                    if (score > alpha && reduction) {
+                        score = -negamax<Opp>(td, board, lower, -alpha, depth - 1, ply + 1);
+                    }
+                    if (options.pvs && score > alpha && score < beta) {
+                        score = -negamax<Opp>(td, board, -beta, -alpha, depth - 1, ply + 1);
+                    }
+                }
+                unmake_move<Color>(board, td.frames[ply].undo);
             }
-            int score = -negamax(next_board, -beta, -alpha, depth - 1, 3 - color, ply + 1);
-            if (stop_search_flag) return 0;
+            if (ctx.stop_search_flag.load(std::memory_order_relaxed)) return 0;
             if (score > best_score) {
                 best_score = score;
                 if (score > alpha) {
                     alpha = score;
                     flag = TT_EXACT;
                     best_move = move;
+                    if (ply == 0) td.root_best_move = move;
+                    td.pv[ply][ply] = move;
+                    for (int k = ply + 1; k < td.pv_length[ply + 1]; ++k) td.pv[ply][k] = td.pv[ply + 1][k];
+                    td.pv_length[ply] = td.pv_length[ply + 1];
+                    if (ply == 0 && !td.root_excluded_count) {
+                        // Ход с оценкой выше alpha просмотрен целиком на новой глубине и лучше
+                        // всех ходов перед ним (первым идёт лучший ход прошлой итерации)
+                        td.partial_line.move = move;
+                        td.partial_line.score = score;
+                        td.partial_line.pv_length = std::min(td.pv_length[0], MAX_PLY);
+                        std::copy(td.pv[0], td.pv[0] + td.partial_line.pv_length, td.partial_line.pv);
+                    }
                     if (score >= beta) {
+                        STAT(td.stats.beta_cutoffs++, td.stats.beta_cutoff_index[std::min(i, STATS_CUTOFF_BUCKETS - 1)]++);
                         if (move.captured_pieces == 0) {
-                            killer_moves[ply][1] = killer_moves[ply][0];
-                            killer_moves[ply][0] = move;
-                            history[bitscan_forward(move.mask_from)-1][bitscan_forward(move.mask_to)-1] += depth * depth;
+                            td.killer_moves[ply][1] = td.killer_moves[ply][0];
+                            td.killer_moves[ply][0] = move;
+                            td.history[bitscan_forward(move.mask_from)-1][bitscan_forward(move.mask_to)-1] += depth * depth;
                         }
-                        tt_entry = {board.hash, best_score, depth, TT_BETA, best_move};
+                        tt_store(board.hash, best_score, depth, TT_BETA, best_move);
                         return beta;
                     }
                 }
             }
         }
-        tt_entry = {board.hash, best_score, depth, flag, best_move};
+        if (ply == 0 && flag == TT_ALPHA) td.root_best_move = best_move;
+        // Поиск корня без части ходов (MultiPV) не должен затирать запись корня в ТТ
+        if (ply > 0 || !td.root_excluded_count) tt_store(board.hash, best_score, depth, flag, best_move);
         return best_score;
     }
-    int quiescence_search(Bitboard& board, int alpha, int beta, int color, int ply) {
-        nodes_searched++;
-        int stand_pat = (color == 1) ? evaluate_giveaway(board) : -evaluate_giveaway(board);
+    template <int Color>
+    int quiescence_search(ThreadData& td, Bitboard& board, SearchFrame* frame, int alpha, int beta, int ply) {
+        td.nodes++;
+        STAT(td.stats.qnodes++);
+        assert(!nnue_active || nnue_matches(frame->accumulator, board));
+        // Эндшпильные таблицы: взятия форсированного поиска как раз и сводят позицию к
+        // табличному материалу. При ply == 0 таблицы уже пробовал вызвавший negamax;
+        // оценка - как в negamax, от корня (номер кадра стека)
+        if (ply > 0 && (int)popcount(board.white_men | board.black_men) <= tb_max_pieces()) {
+            int wdl = tb_probe(board, Color);
+            if (wdl != TB_UNKNOWN) {
+                td.tb_hits++;
+                int root_ply = (int)(frame - td.frames);
+                if (wdl == TB_WIN) return TB_WIN_SCORE - root_ply;
+                if (wdl == TB_LOSS) return -(TB_WIN_SCORE - root_ply);
+                return 0;
+            }
+        }
+        int stand_pat;
+        STAT_TIMED(td.stats.eval_ns, stand_pat = nnue_active ? nnue_evaluate(frame->accumulator, Color)
+                                                             : Side<Color>::eval_sign * evaluate_giveaway(board));
         if (stand_pat >= beta) return beta;
         if (alpha < stand_pat) alpha = stand_pat;
-        auto captures = generate_captures(board, color);
+        MoveList& captures = frame->moves;
+        captures.clear();
+        STAT_TIMED(td.stats.movegen_ns, generate_captures<Color>(board, captures));
+        STAT(count_capture_chains(td.stats, board, captures));
         if (captures.empty() || ply > 8) {
             return stand_pat;
         }
-        int max_captured = 0;
-        for (const auto& m : captures) max_captured = std::max(max_captured, (int)popcount(m.captured_pieces));
         for (const auto& capture : captures) {
-            if (popcount(capture.captured_pieces) < max_captured) continue;
-            Bitboard next_board = apply_move(board, capture, color);
-            int score = -quiescence_search(next_board, -beta, -alpha, 3 - color, ply + 1);
+            int score;
+            if (capture.captured_pieces == board.*Side<Color>::other) {
+                // Как в negamax: соперник остался без фигур и выиграл (ply кадра - от корня)
+                score = -(MATE_SCORE - (int)(frame - td.frames) - 1);
+            } else {
+                make_move<Color>(board, capture, frame);
+                score = -quiescence_search<Side<Color>::opponent>(td, board, frame + 1, -beta, -alpha, ply + 1);
+                unmake_move<Color>(board, frame->undo);
+            }
             if (score >= beta) return beta;
             if (score > alpha) alpha = score;
         }
         return alpha;
     }
-    SearchResult find_best_move(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms_param) {
-        nodes_searched = 0;
-        stop_search_flag = false;
-        time_limit_ms = time_limit_ms_param;
-        search_start_time = std::chrono::steady_clock::now();
-        memset(killer_moves, 0, sizeof(killer_moves));
-        memset(history, 0, sizeof(history));
-        Bitboard root_board = board;
-        root_board.hash = calculate_hash(board, color_to_move);
-        Move best_move_overall{};
-        int best_score_overall = 0;
-        int final_depth = 0;
-        for (int current_depth = 1; current_depth <= max_depth; ++current_depth) {
-            final_depth = current_depth;
-            int score = negamax(root_board, -INFINITY_SCORE, INFINITY_SCORE, current_depth, color_to_move, 0);
-            if (stop_search_flag && current_depth > 1) {
-                final_depth = current_depth - 1;
+
+    // Запись хода для строк info: "c3-d4", взятие - "c3:e5" (поля как IDX_TO_ALG в main.py)
+    const char* const SQUARE_NAMES[32] = {
+        "b1", "d1", "f1", "h1", "a2", "c2", "e2", "g2",
+        "b3", "d3", "f3", "h3", "a4", "c4", "e4", "g4",
+        "b5", "d5", "f5", "h5", "a6", "c6", "e6", "g6",
+        "b7", "d7", "f7", "h7", "a8", "c8", "e8", "g8"
+    };
+
+    std::string move_to_string(const Move& m) {
+        if (!m.mask_from) return "0000";
+        return std::string(SQUARE_NAMES[bitscan_forward(m.mask_from) - 1]) + (m.captured_pieces ? ":" : "-") +
+               SQUARE_NAMES[bitscan_forward(m.mask_to) - 1];
+    }
+
+    // Отсечение по ТТ обрывает вариант в треугольной таблице; продолжаем его лучшими
+    // ходами из ТТ, пока они легальны, но не дальше глубины итерации
+    void extend_pv_from_tt(const SearchContext& ctx, RootLine& line, int depth) {
+        Bitboard board = ctx.root_board;
+        int color = ctx.color_to_move;
+        for (int i = 0; i < line.pv_length; ++i) {
+            board = apply_move(board, line.pv[i], color);
+            color = 3 - color;
+        }
+        while (line.pv_length < std::min(depth, MAX_PLY)) {
+            TT_Entry entry;
+            if (!tt_probe(board.hash, entry) || !entry.best_move.mask_from) break;
+            MoveList moves;
+            generate_legal_moves(board, color, moves);
+            const Move* found = nullptr;
+            for (const auto& m : moves) {
+                if (m.mask_from == entry.best_move.mask_from && m.mask_to == entry.best_move.mask_to) {
+                    found = &m;
+                    break;
+                }
+            }
+            if (!found) break;
+            line.pv[line.pv_length++] = *found;
+            board = apply_move(board, *found, color);
+            color = 3 - color;
+        }
+    }
+
+    // Поиск корня на глубину depth. С аспирационным окном ищем узким окном вокруг
+    // оценки прошлой итерации и при выходе за окно расширяем его вдвое в ту же сторону.
+    int search_root(ThreadData& td, int depth, int previous_score, bool use_aspiration) {
+        SearchContext& ctx = *td.ctx;
+        int delta = ctx.options.aspiration_window;
+        int alpha = -INFINITY_SCORE, beta = INFINITY_SCORE;
+        if (ctx.options.aspiration && use_aspiration && abs(previous_score) < MATE_SCORE - 2 * MAX_PLY) {
+            alpha = std::max(previous_score - delta, -INFINITY_SCORE);
+            beta = std::min(previous_score + delta, INFINITY_SCORE);
+        }
+        if (nnue_active) nnue_refresh(ctx.root_board, td.frames[0].accumulator);
+        while (true) {
+            Bitboard board = ctx.root_board;
+            int score = ctx.color_to_move == 1 ? negamax<1>(td, board, alpha, beta, depth, 0)
+                                               : negamax<2>(td, board, alpha, beta, depth, 0);
+            if (ctx.stop_search_flag.load(std::memory_order_relaxed)) return score;
+            if (score <= alpha && alpha > -INFINITY_SCORE) {
+                alpha = std::max(score - delta, -INFINITY_SCORE);
+            } else if (score >= beta && beta < INFINITY_SCORE) {
+                beta = std::min(score + delta, INFINITY_SCORE);
+            } else {
+                return score;
+            }
+            delta *= 2;
+        }
+    }
+
+    // Решение главного потока после завершённой итерации: начинать ли следующую
+    // Вне игры на время ищем до заказанной глубины (жёсткий лимит действует в negamax)
+    bool continue_deepening(SearchContext& ctx, const Move& best_move) {
+        if (!ctx.timed_play) return true;
+        if (ctx.root_move_count <= 1) return false; // единственный ход: думать не о чем
+        const std::vector<IterationInfo>& iterations = ctx.iterations;
+        bool stable = iterations.size() >= 2 && same_move(best_move, ctx.previous_best_move);
+        ctx.best_move_stability = stable ? ctx.best_move_stability + 1 : 0;
+        ctx.previous_best_move = best_move;
+        double scale = std::max(TM_MIN_STABILITY_SCALE, 1.0 - TM_STABILITY_STEP * ctx.best_move_stability);
+        if (iterations.size() >= 2) {
+            int drop = iterations[iterations.size() - 2].score - iterations.back().score;
+            if (drop >= TM_SCORE_COLLAPSE) scale *= 2.0;
+            else if (drop >= TM_SCORE_DROP) scale *= 1.5;
+        }
+        if (ctx.pondering.load(std::memory_order_acquire)) return true; // время ещё не пошло
+        return elapsed_ms(ctx.search_start_time) < std::min(ctx.soft_limit_ms * scale, (double)ctx.time_limit_ms);
+    }
+
+    // Итерация главного потока оборвана по времени: если в ней уже найден ход лучше
+    // прошлого лучшего, он и становится результатом (глубина остаётся прежней)
+    void use_partial_iteration(ThreadData& td) {
+        const RootLine& partial = td.partial_line;
+        if (!partial.move.mask_from || !td.root_line_count || same_move(partial.move, td.root_lines[0].move)) return;
+        int kept = 1;
+        for (int i = 1; i < td.root_line_count; ++i) {
+            if (!same_move(td.root_lines[i].move, partial.move)) td.root_lines[kept++] = td.root_lines[i];
+        }
+        td.root_line_count = kept;
+        td.root_lines[0] = partial;
+        td.best_score = partial.score;
+    }
+
+    // Итеративное углубление одного потока. Главный поток (id 0) печатает info и
+    // останавливает помощников; помощники с нечётным id начинают на глубину дальше,
+    // чтобы потоки расходились по дереву (Lazy SMP) и делились результатами через ТТ.
+    // В режиме MultiPV каждая итерация ищет корень multi_pv раз полным окном, каждый раз
+    // исключая уже найденные ходы, так что оценки всех строк точные.
+    void iterative_deepening(ThreadData& td) {
+        SearchContext& ctx = *td.ctx;
+        int lines_wanted = std::max(1, std::min({ctx.multi_pv, ctx.root_move_count, MAX_MULTI_PV}));
+        int start_depth = 1 + (td.id & 1);
+        for (int current_depth = start_depth; current_depth <= ctx.max_depth; ++current_depth) {
+            RootLine lines[MAX_MULTI_PV];
+            int line_count = 0;
+            bool interrupted = false;
+            td.root_excluded_count = 0;
+            td.partial_line.move = Move{};
+            for (int i = 0; i < lines_wanted && !interrupted; ++i) {
+                int score = search_root(td, current_depth, i == 0 ? td.best_score : 0, i == 0 && td.completed_depth >= 3);
+                interrupted = ctx.stop_search_flag.load(std::memory_order_relaxed);
+                // Прерванный поиск строки годится только как первая строка первой глубины
+                if (interrupted && (i > 0 || td.completed_depth > 0 || td.id != 0)) break;
+                RootLine& line = lines[line_count++];
+                line.move = td.root_best_move;
+                line.score = score;
+                line.pv_length = std::min(td.pv_length[0], MAX_PLY);
+                std::copy(td.pv[0], td.pv[0] + line.pv_length, line.pv);
+                extend_pv_from_tt(ctx, line, current_depth);
+                td.root_excluded[td.root_excluded_count++] = td.root_best_move;
+            }
+            td.root_excluded_count = 0;
+            // Прерванную итерацию главный поток принимает только на первой глубине
+            if (interrupted && (td.completed_depth > 0 || td.id != 0)) {
+                if (td.id == 0) use_partial_iteration(td);
                 break;
             }
-            TT_Entry& tt_entry = transposition_table[root_board.hash & tt_mask];
-            best_move_overall = tt_entry.best_move;
-            best_score_overall = score;
-            auto now = std::chrono::steady_clock::now();
-            double elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - search_start_time).count();
-            std::cout << "info depth " << current_depth << " score cp " << best_score_overall
-                      << " nodes " << nodes_searched << " time " << (int)elapsed << " pv " << std::endl;
-            if (abs(best_score_overall) >= MATE_SCORE - MAX_PLY) {
+            std::stable_sort(lines, lines + line_count, [](const RootLine& a, const RootLine& b) {
+                return a.score > b.score;
+            });
+            std::copy(lines, lines + line_count, td.root_lines);
+            td.root_line_count = line_count;
+            td.completed_depth = current_depth;
+            td.best_score = lines[0].score;
+            if (td.id == 0) {
+                double elapsed = elapsed_ms(ctx.search_start_time);
+                ctx.iterations.push_back({current_depth, td.best_score, td.nodes, elapsed});
+                if (ctx.info_output) {
+                    for (int i = 0; i < line_count; ++i) {
+                        std::cout << "info depth " << current_depth;
+                        if (lines_wanted > 1) std::cout << " multipv " << i + 1;
+                        std::cout << " score cp " << lines[i].score << " nodes " << td.nodes << " time " << (int)elapsed << " pv";
+                        for (int j = 0; j < lines[i].pv_length; ++j) std::cout << " " << move_to_string(lines[i].pv[j]);
+                        std::cout << std::endl;
+                    }
+                }
+                if (ctx.on_progress) {
+                    long long nps = elapsed > 0 ? (long long)(td.nodes * 1000.0 / elapsed) : td.nodes;
+                    for (int i = 0; i < line_count; ++i) {
+                        ctx.on_progress({current_depth, i + 1, lines[i].score, td.nodes, elapsed, nps,
+                                         std::vector<Move>(lines[i].pv, lines[i].pv + lines[i].pv_length)});
+                    }
+                }
+            }
+            if (abs(td.best_score) >= MATE_SCORE - MAX_PLY) {
+                break;
+            }
+            if (td.id == 0 && !continue_deepening(ctx, lines[0].move)) {
+                ctx.stop_search_flag.store(true, std::memory_order_relaxed);
                 break;
             }
         }
-        auto end_time = std::chrono::steady_clock::now();
-        double total_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - search_start_time).count();
-        return {best_move_overall, best_score_overall, nodes_searched, total_time, final_depth};
     }
-}
+
+    // Поколение ТТ (tt_new_search) вызывающий сдвигает сам: пакетный анализ делает это
+    // на каждую позицию, самоигра - на каждую партию
+    void prepare_search(SearchContext& ctx, const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms,
+                        int num_threads, int multi_pv = 1) {
+        ctx.root_board = board;
+        ctx.root_board.hash = calculate_hash(board, color_to_move);
+        ctx.color_to_move = color_to_move;
+        ctx.max_depth = max_depth;
+        ctx.time_limit_ms = time_limit_ms;
+        ctx.soft_limit_ms = time_limit_ms * TM_SOFT_FRACTION;
+        MoveList root_moves;
+        generate_legal_moves(ctx.root_board, color_to_move, root_moves);
+        ctx.root_move_count = root_moves.size();
+        ctx.best_move_stability = 0;
+        ctx.previous_best_move = Move{};
+        ctx.multi_pv = multi_pv;
+        ctx.options = search_options;
+        ctx.stop_search_flag.store(false);
+        ctx.stop_token.reset();
+        ctx.on_progress = nullptr;
+        ctx.iterations.clear();
+        ctx.threads.clear();
+        for (int i = 0; i < num_threads; ++i) {
+            ctx.threads.emplace_back(new ThreadData()); // () обнуляет все поля
+            ctx.threads.back()->id = i;
+            ctx.threads.back()->ctx = &ctx;
+        }
+        ctx.pondering.store(false);
+        ctx.use_book = false;
+        ctx.timed_play = false;
+        ctx.search_start_time = std::chrono::steady_clock::now();
+    }
+
+    SearchResult run_search(SearchContext& ctx) {
+        // Позиция есть в дебютной книге: ход без поиска
+        Move book_move;
+        int book_score;
+        if (ctx.use_book && book_probe(ctx.root_board, ctx.color_to_move, book_move, book_score)) {
+            SearchResult result{};
+            result.best_move = book_move;
+            result.score = book_score;
+            result.from_book = true;
+            result.pv = {book_move};
+            result.lines.push_back({book_move, book_score, result.pv});
+            result.time_taken_ms = elapsed_ms(ctx.search_start_time);
+            if (ctx.info_output) {
+                std::cout << "info book move " << move_to_string(book_move) << " score cp " << book_score << std::endl;
+            }
+            return result;
+        }
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < ctx.threads.size(); ++i) {
+            helpers.emplace_back(iterative_deepening, std::ref(*ctx.threads[i]));
+        }
+        iterative_deepening(*ctx.threads[0]);
+        ctx.stop_search_flag.store(true);
+        for (auto& t : helpers) t.join();
+
+        // Берём результат потока, завершившего самую глубокую итерацию (при равенстве - главного)
+        const ThreadData* best_thread = ctx.threads[0].get();
+        SearchResult result{};
+        for (const auto& td : ctx.threads) {
+            result.nodes_searched += td->nodes;
+            result.tt_probes += td->tt_probes;
+            result.tt_hits += td->tt_hits;
+            result.tb_hits += td->tb_hits;
+#ifdef KESTOG_STATS
+            SearchStats thread_stats = td->stats;
+            thread_stats.nodes = td->nodes;
+            thread_stats.tt_probes = td->tt_probes;
+            thread_stats.tt_hits = td->tt_hits;
+            add_search_stats(result.stats, thread_stats);
+#endif
+            if (td->completed_depth > best_thread->completed_depth && td->root_line_count > 0 && td->root_lines[0].move.mask_from) {
+                best_thread = td.get();
+            }
+        }
+        // Ход, оценка и вариант берутся из строк одной и той же завершённой итерации
+        for (int i = 0; i < best_thread->root_line_count; ++i) {
+            const RootLine& line = best_thread->root_lines[i];
+            result.lines.push_back({line.move, line.score, std::vector<Move>(line.pv, line.pv + line.pv_length)});
+        }
+        if (!result.lines.empty()) {
+            result.best_move = result.lines[0].move;
+            result.pv = result.lines[0].pv;
+        }
+        result.score = best_thread->best_score;
+        result.final_depth = best_thread->completed_depth;
+        result.time_taken_ms = elapsed_ms(ctx.search_start_time);
+        result.iterations = ctx.iterations;
+        result.tt_hashfull = tt_hashfull();
+#ifdef KESTOG_STATS
+        {
+            std::lock_guard<std::mutex> lock(search_stats_mutex);
+            add_search_stats(total_search_stats, result.stats);
+        }
+#endif
+        if (ctx.info_output) {
+            long long nps = result.time_taken_ms > 0 ? (long long)(result.nodes_searched * 1000.0 / result.time_taken_ms) : result.nodes_searched;
+            std::cout << "info threads " << ctx.threads.size() << " depth " << result.final_depth
+                      << " nodes " << result.nodes_searched << " nps " << nps << " time " << (int)result.time_taken_ms
+                      << " hashfull " << result.tt_hashfull << std::endl;
+        }
+        return result;
+    }
+
+    SearchResult find_best_move(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv) {
+        return find_best_move(board, color_to_move, max_depth, time_limit_ms, multi_pv, nullptr, nullptr);
+    }
+
+    SearchResult find_best_move(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms,
+                                int multi_pv, const std::shared_ptr<StopToken>& stop_token,
+                                const ProgressCallback& on_progress) {
+        SearchContext ctx;
+        ctx.info_output = info_output_enabled;
+        tt_new_search();
+        prepare_search(ctx, board, color_to_move, max_depth, time_limit_ms, num_search_threads, multi_pv);
+        ctx.stop_token = stop_token;
+        ctx.on_progress = on_progress;
+        ctx.use_book = multi_pv <= 1; // анализ нескольких строк книга не заменит
+        ctx.timed_play = ctx.options.time_management;
+        return run_search(ctx);
+    }
+
+    // --- Пакетный анализ ---
+    // Позиции раздаются рабочим потокам через общий счётчик; у каждого рабочего свой
+    // однопоточный контекст поиска, ТТ общая. Независимые поиски масштабируются по ядрам
+    // лучше, чем Lazy SMP внутри одной позиции. Каждое задание сдвигает поколение ТТ, как
+    // отдельный поиск: иначе замещение по возрасту и tt_hashfull не видят разницы между
+    // записями первой и тысячной позиции.
+    template <typename Fn>
+    void run_batch(size_t count, int num_workers, Fn search_one) {
+        if (num_workers <= 0) num_workers = (int)std::thread::hardware_concurrency();
+        num_workers = (int)std::max<size_t>(1, std::min<size_t>(num_workers, count));
+        std::atomic<size_t> next_index{0};
+        auto worker = [&]() {
+            SearchContext ctx;
+            ctx.info_output = false;
+            for (size_t i = next_index++; i < count; i = next_index++) {
+                tt_new_search();
+                search_one(ctx, i);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < num_workers; ++t) workers.emplace_back(worker);
+        worker();
+        for (auto& w : workers) w.join();
+    }
+
+    // Цвет вне {1, 2} молча искался бы за чёрных: проверяем до запуска рабочих
+    void check_batch_color(int color) {
+        if (color != 1 && color != 2) {
+            throw std::invalid_argument("analyze_positions: color_to_move must be 1 (white) or 2 (black), got " +
+                                        std::to_string(color));
+        }
+    }
+
+    std::vector<SearchResult> analyze_positions(const std::vector<Bitboard>& boards, const std::vector<int>& colors,
+                                                int max_depth, int time_limit_ms, int num_workers) {
+        if (boards.size() != colors.size()) {
+            throw std::invalid_argument("analyze_positions: boards and colors must have the same length");
+        }
+        for (int color : colors) check_batch_color(color);
+        std::vector<SearchResult> results(boards.size());
+        run_batch(results.size(), num_workers, [&](SearchContext& ctx, size_t i) {
+            prepare_search(ctx, boards[i], colors[i], max_depth, time_limit_ms, 1);
+            results[i] = run_search(ctx);
+        });
+        return results;
+    }
+
+    void analyze_positions(const BatchPosition* positions, BatchResult* results, size_t count,
+                           int max_depth, int time_limit_ms, int num_workers) {
+        for (size_t i = 0; i < count; ++i) check_batch_color(positions[i].color_to_move);
+        run_batch(count, num_workers, [&](SearchContext& ctx, size_t i) {
+            const BatchPosition& p = positions[i];
+            Bitboard board{p.white_men, p.black_men, p.kings, 0};
+            prepare_search(ctx, board, p.color_to_move, max_depth, time_limit_ms, 1);
+            SearchResult r = run_search(ctx);
+            BatchResult& out = results[i];
+            out.mask_from = r.best_move.mask_from;
+            out.mask_to = r.best_move.mask_to;
+            out.captured_pieces = r.best_move.captured_pieces;
+            out.nodes = r.nodes_searched;
+            out.time_ms = r.time_taken_ms;
+            out.score = r.score;
+            out.final_depth = r.final_depth;
+            out.becomes_king = r.best_move.becomes_king;
+        });
+    }
+
+    // --- Самоигра ---
+    // Партии раздаются рабочим пакетного анализа. Записи партии копятся в её буфере
+    // (исход известен только в конце) и уходят в общий файл одним fwrite под мьютексом;
+    // сам файл буферизован крупным блоком, так что на диск пишется редко.
+    constexpr size_t SELFPLAY_FILE_BUFFER = 1 << 20;
+
+    SelfPlayStats selfplay(const std::string& path, const SelfPlayConfig& config) {
+        SelfPlayStats stats{};
+        std::vector<char> file_buffer(SELFPLAY_FILE_BUFFER); // переживает fclose
+        std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(path.c_str(), "ab"), std::fclose);
+        if (!file) return stats;
+        std::setvbuf(file.get(), file_buffer.data(), _IOFBF, file_buffer.size());
+        stats.workers = config.num_workers > 0 ? config.num_workers : (int)std::thread::hardware_concurrency();
+        stats.workers = (int)std::max<long long>(1, std::min<long long>(stats.workers, config.games));
+
+        std::mutex output_mutex;
+        std::atomic<bool> write_failed{false};
+        auto start = std::chrono::steady_clock::now();
+        run_batch(std::max(0, config.games), stats.workers, [&](SearchContext& ctx, size_t game) {
+            if (write_failed.load(std::memory_order_relaxed)) return;
+            std::mt19937_64 rng(config.seed ^ (game * 0x9E3779B97F4A7C15ULL));
+            std::vector<SelfPlayRecord> records;
+            Bitboard board{0x00000FFFULL, 0xFFF00000ULL, 0, 0};
+            board.hash = calculate_hash(board, 1);
+            int color = 1, winner = 0;
+            long long nodes = 0;
+            for (int ply = 0; ply < config.max_plies; ++ply) {
+                MoveList moves;
+                generate_legal_moves(board, color, moves);
+                if (moves.empty()) {
+                    winner = color; // в поддавках выигрывает тот, кому нечем ходить
+                    break;
+                }
+                Move move = moves[0];
+                if (ply < config.random_plies) {
+                    move = moves[rng() % moves.size()];
+                } else if (moves.size() > 1) {
+                    prepare_search(ctx, board, color, MAX_PLY, std::numeric_limits<int>::max(), 1);
+                    ctx.options.node_limit = config.nodes_per_move;
+                    SearchResult r = run_search(ctx);
+                    nodes += r.nodes_searched;
+                    if (r.best_move.mask_from) move = r.best_move;
+                    records.push_back({(uint32_t)board.white_men, (uint32_t)board.black_men, (uint32_t)board.kings,
+                                       (int16_t)std::clamp(r.score, -INFINITY_SCORE, INFINITY_SCORE), 0, (uint8_t)color});
+                }
+                board = apply_move(board, move, color);
+                color = 3 - color;
+            }
+            for (auto& rec : records) {
+                rec.result = winner == 0 ? 0 : (winner == rec.color_to_move ? 1 : -1);
+            }
+
+            std::lock_guard<std::mutex> lock(output_mutex);
+            if (std::fwrite(records.data(), sizeof(SelfPlayRecord), records.size(), file.get()) != records.size()) {
+                write_failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+            stats.games++;
+            stats.positions += records.size();
+            stats.nodes += nodes;
+            if (winner == 1) stats.white_wins++;
+            else if (winner == 2) stats.black_wins++;
+            else stats.draws++;
+        });
+        stats.ok = !write_failed.load() && std::fflush(file.get()) == 0;
+        stats.time_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (stats.time_s > 0) stats.positions_per_second_per_core = stats.positions / stats.time_s / stats.workers;
+        return stats;
+    }
+
+    // --- Неблокирующий поиск ---
+    SearchHandle::SearchHandle() : ctx(new SearchContext()), finished(true), search_result{} {}
+
+    SearchHandle::~SearchHandle() {
+        stop();
+        if (worker.joinable()) worker.join();
+    }
+
+    void SearchHandle::start(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv,
+                             const std::shared_ptr<StopToken>& stop_token, const ProgressCallback& on_progress) {
+        launch(board, color_to_move, max_depth, time_limit_ms, multi_pv, false, stop_token, on_progress);
+    }
+
+    void SearchHandle::ponder(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv,
+                              const std::shared_ptr<StopToken>& stop_token, const ProgressCallback& on_progress) {
+        launch(board, color_to_move, max_depth, time_limit_ms, multi_pv, true, stop_token, on_progress);
+    }
+
+    void SearchHandle::ponderhit() {
+        ctx->pondering.store(false, std::memory_order_release);
+    }
+
+    bool SearchHandle::is_pondering() const {
+        return ctx->pondering.load() && !finished.load();
+    }
+
+    void SearchHandle::launch(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv,
+                              bool ponder, const std::shared_ptr<StopToken>& stop_token,
+                              const ProgressCallback& on_progress) {
+        stop();
+        if (worker.joinable()) worker.join();
+        ctx->info_output = info_output_enabled;
+        tt_new_search();
+        prepare_search(*ctx, board, color_to_move, max_depth, time_limit_ms, num_search_threads, multi_pv);
+        ctx->pondering.store(ponder);
+        ctx->stop_token = stop_token;
+        ctx->on_progress = on_progress;
+        ctx->use_book = multi_pv <= 1;
+        ctx->timed_play = ctx->options.time_management;
+        search_result = SearchResult{};
+        finished.store(false);
+        worker = std::thread([this]() {
+            search_result = run_search(*ctx);
+            finished.store(true);
+        });
+    }
+
+    bool SearchHandle::poll() const {
+        return finished.load();
+    }
+
+    void SearchHandle::stop() {
+        ctx->stop_search_flag.store(true);
+    }
+
+    SearchResult SearchHandle::result() {
+        if (worker.joinable()) worker.join();
+        return search_result;
+    }
+}
\ No newline at end of file
@@ -1,7 +1,12 @@
 #pragma once
 #include <cstdint>
+#include <cassert>
 #include <vector>
 #include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 namespace kestog_core {
     using u64 = uint64_t;
@@ -22,14 +27,78 @@ namespace kestog_core {
         int score; // Для упорядочивания ходов
     };
 
+    // --- Список ходов фиксированной ёмкости ---
+    // Поиск держит списки в своём стеке кадров (по одному на полуход), поэтому генерация
+    // ходов в поиске не трогает кучу.
+    // Генератор кладёт в список только взятия максимальной длины, поэтому даже в
+    // позициях с сотнями коротких цепочек ходов остаётся немного; переполнение
+    // ловит assert отладочной сборки.
+    constexpr int MAX_MOVES = 256;
+    struct MoveList {
+        Move moves[MAX_MOVES];
+        int count = 0;
+
+        void push_back(const Move& m) {
+            assert(count < MAX_MOVES && "MoveList переполнен");
+            if (count < MAX_MOVES) moves[count++] = m;
+        }
+        void clear() { count = 0; }
+        int size() const { return count; }
+        bool empty() const { return count == 0; }
+        Move& operator[](int i) { return moves[i]; }
+        const Move& operator[](int i) const { return moves[i]; }
+        Move* begin() { return moves; }
+        Move* end() { return moves + count; }
+        const Move* begin() const { return moves; }
+        const Move* end() const { return moves + count; }
+    };
+
     // --- Транспозиционная таблица ---
+    // В самой таблице записи хранятся упакованными (см. KestoG_Core.cpp),
+    // TT_Entry - их распакованный вид, который возвращает проба.
     enum TT_FLAG { TT_EXACT, TT_ALPHA, TT_BETA };
     struct TT_Entry {
-        u64 hash_lock;
         int score;
         int depth;
         TT_FLAG flag;
-        Move best_move;
+        Move best_move; // только from/to и превращение
+    };
+
+    // --- Статистика одной завершённой итерации углубления (главный поток) ---
+    struct IterationInfo {
+        int depth;
+        int score;
+        long long nodes;  // узлы главного потока с начала поиска
+        double time_ms;   // время с начала поиска
+    };
+
+    // Одна строка MultiPV: ход корня, его точная оценка и вариант, начинающийся с этого хода
+    struct PVLine {
+        Move move;
+        int score;
+        std::vector<Move> pv;
+    };
+
+    // --- Счётчики поиска для профилирования ---
+    // Считаются только в сборке с -DKESTOG_STATS (KESTOG_STATS=1 python setup.py ...);
+    // в обычной сборке код подсчёта не компилируется и все поля нулевые.
+    constexpr int STATS_CUTOFF_BUCKETS = 8;
+    struct SearchStats {
+        long long nodes;                  // узлы negamax и форсированного поиска
+        long long qnodes;                 // из них узлы форсированного поиска
+        long long tt_probes;
+        long long tt_hits;
+        long long tt_cutoffs_exact;       // отсечения по записи ТТ, по флагам
+        long long tt_cutoffs_alpha;
+        long long tt_cutoffs_beta;
+        long long beta_cutoffs;
+        long long beta_cutoff_index[STATS_CUTOFF_BUCKETS]; // по номеру хода в списке, последний - все дальше
+        long long capture_moves;          // сгенерированные в поиске взятия
+        long long capture_chain_pieces;   // сумма длин их цепочек (взятых фигур)
+        long long king_capture_moves;     // то же для взятий дамкой (find_king_jumps)
+        long long king_chain_pieces;
+        long long movegen_ns;             // время генерации ходов
+        long long eval_ns;                // время статической оценки
     };
 
     // --- Структура для передачи результатов поиска ---
@@ -39,20 +108,212 @@ namespace kestog_core {
         long long nodes_searched;
         double time_taken_ms;
         int final_depth;
+        long long tt_probes;  // по всем потокам
+        long long tt_hits;
+        int tt_hashfull;      // заполненность ТТ текущим поиском, промилле
+        long long tb_hits;    // узлы, оценённые по эндшпильным таблицам
+        std::vector<IterationInfo> iterations;
+        std::vector<Move> pv;         // главный вариант (начинается с best_move)
+        std::vector<PVLine> lines;    // лучшие ходы корня по убыванию оценки (MultiPV)
+        bool from_book;               // ход взят из дебютной книги, поиска не было
+        SearchStats stats;            // по всем потокам (только при KESTOG_STATS)
     };
 
     // --- Основные функции, вызываемые из Python ---
 
-    // Инициализация движка (Zobrist ключи, ТТ)
-    void init_engine(int tt_size_mb);
+    // Инициализация движка (Zobrist ключи, ТТ, число потоков Lazy SMP).
+    // Если задан tt_path, ТТ живёт в отображённом в память файле и переживает перезапуск.
+    // Если задан nnue_path, позиции оценивает нейросеть с весами из этого файла (KestoG_NNUE.hpp).
+    void init_engine(int tt_size_mb, int num_threads = 1, const std::string& tt_path = "",
+                     const std::string& nnue_path = "");
+
+    // Сбрасывает файловую ТТ на диск (msync). false, если ТТ не файловая или запись не удалась.
+    bool save_transposition_table();
+
+    // Очистка ТТ (например, перед каждой позицией бенчмарка)
+    void clear_transposition_table();
+
+    // Заполненность ТТ записями последнего поиска, промилле
+    int tt_hashfull();
+
+    // Включает/выключает строки "info ..." в stdout
+    void set_info_output(bool enabled);
+
+    // Собран ли движок с KESTOG_STATS
+    bool search_stats_enabled();
+    // Сумма SearchResult::stats всех поисков с последнего сброса (в том числе пакетных и самоигры)
+    SearchStats get_search_stats();
+    void reset_search_stats();
+
+    // --- Переключатели поиска (для замеров на бенчмарке и самоигры) ---
+    struct SearchOptions {
+        bool aspiration = true;      // аспирационное окно вокруг оценки прошлой итерации
+        int aspiration_window = 50;  // начальная полуширина окна
+        bool pvs = true;             // поиск с нулевым окном для всех ходов, кроме первого
+        bool lmr = true;             // сокращение глубины для поздних тихих ходов
+        int lmr_min_depth = 3;       // не сокращаем ближе к листьям
+        int lmr_full_moves = 3;      // столько первых ходов всегда на полную глубину
+        long long node_limit = 0;    // поиск останавливается после стольких узлов главного потока (0 - без лимита)
+        // Игра на время (find_best_move, SearchHandle): мягкий лимит и мгновенный ответ
+        // единственным ходом. Выключено - ищем до max_depth, пока не кончится жёсткий
+        // лимит; пакетный анализ, самоигра и книга всегда ищут так
+        bool time_management = true;
+    };
+
+    // Применяется к поискам, запущенным после вызова
+    void set_search_options(const SearchOptions& options);
+    SearchOptions get_search_options();
+
+    // Главная функция поиска лучшего хода. multi_pv > 1 - точные оценки и варианты
+    // для стольких лучших ходов корня (не больше MAX_MULTI_PV)
+    constexpr int MAX_MULTI_PV = 16;
+    SearchResult find_best_move(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms,
+                                int multi_pv = 1);
+
+    // --- Пакетный анализ: много позиций за один вызов на пуле рабочих потоков ---
+    // Плоские записи без указателей: из Python их можно передавать структурными
+    // массивами NumPy без копирования.
+    struct BatchPosition {
+        u64 white_men;
+        u64 black_men;
+        u64 kings;
+        int32_t color_to_move;
+    };
+
+    struct BatchResult {
+        u64 mask_from;        // лучший ход (0, если ходов нет)
+        u64 mask_to;
+        u64 captured_pieces;
+        int64_t nodes;
+        double time_ms;
+        int32_t score;
+        int32_t final_depth;
+        int32_t becomes_king;
+    };
+
+    // Каждая позиция ищется отдельно (один поток на позицию) с бюджетом max_depth/time_limit_ms.
+    // num_workers <= 0 - по числу ядер. Строки info не печатаются. Разная длина boards и
+    // colors или цвет не 1/2 - std::invalid_argument (в Python - ValueError).
+    std::vector<SearchResult> analyze_positions(const std::vector<Bitboard>& boards, const std::vector<int>& colors,
+                                                int max_depth, int time_limit_ms, int num_workers = 0);
+    void analyze_positions(const BatchPosition* positions, BatchResult* results, size_t count,
+                           int max_depth, int time_limit_ms, int num_workers = 0);
+
+    // --- Самоигра: размеченные позиции для настройки и обучения оценки ---
+    // Файл - последовательность записей фиксированного размера (little-endian, без
+    // заголовка): файлы можно склеивать и читать как массив (numpy.fromfile с
+    // SELFPLAY_RECORD_DTYPE).
+    struct SelfPlayRecord {
+        uint32_t white_men;
+        uint32_t black_men;
+        uint32_t kings;
+        int16_t score;          // оценка поиска за сторону на ходу
+        int8_t result;          // исход партии для стороны на ходу: 1 - победа, 0 - ничья, -1 - поражение
+        uint8_t color_to_move;  // 1 - белые, 2 - чёрные
+    };
+    static_assert(sizeof(SelfPlayRecord) == 16, "запись самоигры должна оставаться 16-байтной");
+
+    struct SelfPlayConfig {
+        int games = 1000;
+        long long nodes_per_move = 5000;  // лимит узлов каждого поиска
+        int random_plies = 8;             // столько первых полуходов случайны и не записываются
+        int max_plies = 300;              // партия длиннее - ничья
+        int num_workers = 0;              // параллельных партий; <= 0 - по числу ядер
+        uint64_t seed = 1;                // партия i разыгрывает дебют от seed и i
+    };
+
+    struct SelfPlayStats {
+        bool ok;                  // false, если файл не открылся или запись не удалась
+        long long games;
+        long long positions;      // записанные позиции
+        long long white_wins;
+        long long black_wins;
+        long long draws;
+        long long nodes;
+        double time_s;
+        int workers;
+        double positions_per_second_per_core;
+    };
+
+    // Играет config.games партий сам с собой (по однопоточному поиску на партию, ТТ
+    // общая) и дописывает позиции в файл path. Позиции с единственным ходом не пишутся.
+    SelfPlayStats selfplay(const std::string& path, const SelfPlayConfig& config);
 
-    // Главная функция поиска лучшего хода
-    SearchResult find_best_move(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms);
+    // --- Внешняя остановка и ход поиска ---
+    // Токен остановки разделяется между вызывающим и поиском; request_stop() можно
+    // вызывать из любого потока, поиск заметит его в пределах ~2048 узлов.
+    class StopToken {
+    public:
+        void request_stop() { stopped.store(true, std::memory_order_relaxed); }
+        bool stop_requested() const { return stopped.load(std::memory_order_relaxed); }
+        void reset() { stopped.store(false, std::memory_order_relaxed); }
+    private:
+        std::atomic<bool> stopped{false};
+    };
+
+    // Сведения о завершённой итерации (по одной на строку MultiPV)
+    struct SearchProgress {
+        int depth;
+        int multipv;          // номер строки, с 1
+        int score;
+        long long nodes;      // узлы главного потока с начала поиска
+        double time_ms;
+        long long nps;
+        std::vector<Move> pv;
+    };
+
+    // Вызывается из потока поиска после каждой итерации; должна быть быстрой
+    using ProgressCallback = std::function<void(const SearchProgress&)>;
+
+    SearchResult find_best_move(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms,
+                                int multi_pv, const std::shared_ptr<StopToken>& stop_token,
+                                const ProgressCallback& on_progress);
+
+    // --- Неблокирующий поиск: запуск в фоне, опрос, остановка, результат ---
+    // Каждый хендл владеет своим контекстом поиска, поэтому много партий
+    // могут искать одновременно в одном процессе (ТТ остаётся общей).
+    struct SearchContext;
+    class SearchHandle {
+    public:
+        SearchHandle();
+        ~SearchHandle();
+        SearchHandle(const SearchHandle&) = delete;
+        SearchHandle& operator=(const SearchHandle&) = delete;
+
+        void start(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv = 1,
+                   const std::shared_ptr<StopToken>& stop_token = nullptr, const ProgressCallback& on_progress = nullptr);
+        // Обдумывание на времени соперника: поиск без лимита времени (в ту же общую ТТ)
+        // позиции после ожидаемого ответа. ponderhit() - ответ угадан, поиск продолжается
+        // как обычный, а время обдумывания засчитывается в time_limit_ms; при промахе -
+        // stop() и start() (стоп мгновенный, ТТ остаётся прогретой).
+        void ponder(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv = 1,
+                    const std::shared_ptr<StopToken>& stop_token = nullptr, const ProgressCallback& on_progress = nullptr);
+        void ponderhit();
+        bool is_pondering() const;
+        bool poll() const;      // true, если поиск завершён (или не запускался)
+        void stop();            // досрочная остановка; результат последней итерации сохраняется
+        SearchResult result();  // дожидается завершения и возвращает результат
+
+    private:
+        void launch(const Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv, bool ponder,
+                    const std::shared_ptr<StopToken>& stop_token, const ProgressCallback& on_progress);
+
+        std::unique_ptr<SearchContext> ctx;
+        std::thread worker;
+        std::atomic<bool> finished;
+        SearchResult search_result;
+    };
 
     // Функции для генерации ходов (остаются для валидации и UI)
     std::vector<Move> generate_legal_moves(const Bitboard& board, int color_to_move);
+    void generate_legal_moves(const Bitboard& board, int color_to_move, MoveList& moves);
     Bitboard apply_move(const Bitboard& board, const Move& move, int color_to_move);
     
+    // --- Perft: число листьев дерева ходов на заданной глубине (проверка и замер генератора) ---
+    long long perft(const Bitboard& board, int color_to_move, int depth);
+    // То же, но с разбивкой по ходам корня
+    std::vector<std::pair<Move, long long>> perft_divide(const Bitboard& board, int color_to_move, int depth);
+
     // Вспомогательная функция для создания хеша с нуля
     u64 calculate_hash(const Bitboard& board, int color_to_move);
 }
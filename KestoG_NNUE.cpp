@@ -0,0 +1,108 @@
+#include "KestoG_NNUE.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace kestog_core {
+
+    NNUE_Weights nnue_weights;
+    bool nnue_active = false;
+
+#if defined(NNUE_AVX2_KERNELS)
+    bool nnue_cpu_avx2 = [] {
+        __builtin_cpu_init(); // вызов до main: cpu-таблица libgcc может быть ещё не заполнена
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+#endif
+
+    namespace {
+        template <typename T>
+        bool read_array(std::ifstream& in, T* data, size_t count) {
+            return (bool)in.read(reinterpret_cast<char*>(data), sizeof(T) * count);
+        }
+    }
+
+    bool nnue_load(const std::string& path) {
+        nnue_active = false;
+        if (path.empty()) return false;
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        NNUE_FileHeader header;
+        if (!read_array(in, &header, 1) || std::memcmp(header.magic, "KESTOGNN", 8) != 0 ||
+            header.version != NNUE_FILE_VERSION || header.inputs != NNUE_INPUTS || header.hidden != NNUE_HIDDEN) {
+            return false;
+        }
+        if (!read_array(in, nnue_weights.ft_bias, NNUE_HIDDEN) ||
+            !read_array(in, &nnue_weights.ft_weights[0][0], (size_t)NNUE_INPUTS * NNUE_HIDDEN) ||
+            !read_array(in, nnue_weights.out_weights, 2 * NNUE_HIDDEN) ||
+            !read_array(in, &nnue_weights.out_bias, 1) || in.peek() != std::char_traits<char>::eof()) {
+            return false;
+        }
+        nnue_active = true;
+        return true;
+    }
+
+    bool nnue_enabled() {
+        return nnue_active;
+    }
+
+    void nnue_refresh(const Bitboard& board, NNUE_Accumulator& acc) {
+        for (int p = 0; p < 2; ++p) {
+            int features[32];
+            int count = 0;
+            for (u64 pieces = board.white_men | board.black_men; pieces; pieces &= pieces - 1) {
+                int sq = __builtin_ctzll(pieces);
+                int color = (board.white_men >> sq) & 1 ? 1 : 2;
+                features[count++] = nnue_feature(p, color, (board.kings >> sq) & 1, sq);
+            }
+            nnue_update_values(nnue_weights.ft_bias, acc.values[p], features, count, nullptr, 0);
+        }
+    }
+
+    bool nnue_matches(const NNUE_Accumulator& acc, const Bitboard& board) {
+        NNUE_Accumulator fresh;
+        nnue_refresh(board, fresh);
+        return std::memcmp(&fresh, &acc, sizeof(fresh)) == 0;
+    }
+
+#if defined(NNUE_AVX2_KERNELS)
+    // Выходной слой: сумма clamp(acc, 0, QA) * out_weights по обеим перспективам
+    NNUE_AVX2_TARGET int32_t nnue_output_sum_avx2(const int16_t* us, const int16_t* them) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i qa = _mm256_set1_epi16(NNUE_QA);
+        __m256i total = _mm256_setzero_si256();
+        for (int half = 0; half < 2; ++half) {
+            const __m256i* in = (const __m256i*)(half == 0 ? us : them);
+            const __m256i* w = (const __m256i*)nnue_weights.out_weights + half * (NNUE_HIDDEN / 16);
+            for (int r = 0; r < NNUE_HIDDEN / 16; ++r) {
+                __m256i v = _mm256_min_epi16(_mm256_max_epi16(_mm256_load_si256(in + r), zero), qa);
+                total = _mm256_add_epi32(total, _mm256_madd_epi16(v, _mm256_load_si256(w + r)));
+            }
+        }
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+        return _mm_cvtsi128_si32(s);
+    }
+#endif
+
+    int32_t nnue_output_sum_scalar(const int16_t* us, const int16_t* them) {
+        int32_t sum = 0;
+        for (int j = 0; j < NNUE_HIDDEN; ++j) {
+            sum += std::clamp<int>(us[j], 0, NNUE_QA) * nnue_weights.out_weights[j];
+            sum += std::clamp<int>(them[j], 0, NNUE_QA) * nnue_weights.out_weights[NNUE_HIDDEN + j];
+        }
+        return sum;
+    }
+
+    int nnue_evaluate(const NNUE_Accumulator& acc, int color_to_move) {
+        const int16_t* us = acc.values[color_to_move - 1];
+        const int16_t* them = acc.values[2 - color_to_move];
+#if defined(NNUE_AVX2_KERNELS)
+        int32_t sum = nnue_use_avx2() ? nnue_output_sum_avx2(us, them) : nnue_output_sum_scalar(us, them);
+#else
+        int32_t sum = nnue_output_sum_scalar(us, them);
+#endif
+        long long score = ((long long)sum + nnue_weights.out_bias) * NNUE_OUTPUT_SCALE / (NNUE_QA * NNUE_QB);
+        return (int)std::clamp<long long>(score, -NNUE_EVAL_LIMIT, NNUE_EVAL_LIMIT);
+    }
+}
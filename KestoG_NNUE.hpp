@@ -0,0 +1,150 @@
+#pragma once
+#include "KestoG_Core.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+// Ядра AVX2 собираются для любой x86-сборки атрибутом target, поэтому переносимая
+// сборка не требует AVX2 от процессора, а выбирает ядро по CPUID (nnue_use_avx2)
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define NNUE_AVX2_KERNELS 1
+#define NNUE_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace kestog_core {
+
+    // =================================================================================
+    // >>>>> НЕЙРОСЕТЕВАЯ ОЦЕНКА (NNUE) <<<<<
+    // Вход - 4x32 признака "фигура на поле" (те же, что перебирает ZOBRIST), в двух
+    // перспективах: для белых поля как есть, для чёрных доска повёрнута на 180 градусов,
+    // и в каждой перспективе фигуры делятся на свои и чужие. Первый слой (128 -> 64)
+    // хранится как аккумулятор и обновляется по ходу инкрементально: ход меняет лишь
+    // несколько признаков. Дальше clipped ReLU обеих перспектив (сначала сторона на
+    // ходу) и выходной нейрон. Всё в int16/int32, ядра на AVX2 со скалярным запасным путём
+    // (выбор при запуске, если сборка не под AVX2).
+    //
+    // Файл весов (little-endian): NNUE_FileHeader, затем int16 ft_bias[64],
+    // int16 ft_weights[128][64], int16 out_weights[128], int32 out_bias.
+    // Признак: (вид * 32 + поле), вид 0 - своя простая, 1 - чужая простая, 2 - своя
+    // дамка, 3 - чужая дамка. Оценка за сторону на ходу:
+    //   (sum clamp(acc, 0, QA) * out_weights + out_bias) * NNUE_OUTPUT_SCALE / (QA * QB)
+    // =================================================================================
+    constexpr int NNUE_INPUTS = 128;
+    constexpr int NNUE_HIDDEN = 64;
+    constexpr int NNUE_QA = 255;            // верхняя граница активации первого слоя
+    constexpr int NNUE_QB = 64;             // масштаб выходных весов
+    constexpr int NNUE_OUTPUT_SCALE = 100;  // выход сети 1.0 = 100 (цена простой)
+    constexpr int NNUE_EVAL_LIMIT = 5000;   // оценка сети не должна выглядеть как выигрыш
+    constexpr uint32_t NNUE_FILE_VERSION = 1;
+
+    struct NNUE_FileHeader {
+        char magic[8];      // "KESTOGNN"
+        uint32_t version;   // NNUE_FILE_VERSION
+        uint32_t inputs;    // NNUE_INPUTS
+        uint32_t hidden;    // NNUE_HIDDEN
+        uint32_t reserved;
+    };
+
+    struct NNUE_Weights {
+        alignas(32) int16_t ft_bias[NNUE_HIDDEN];
+        alignas(32) int16_t ft_weights[NNUE_INPUTS][NNUE_HIDDEN];
+        alignas(32) int16_t out_weights[2 * NNUE_HIDDEN];
+        int32_t out_bias;
+    };
+
+    // Первый слой для обеих перспектив: [0] - белые, [1] - чёрные
+    struct alignas(32) NNUE_Accumulator {
+        int16_t values[2][NNUE_HIDDEN];
+    };
+
+    // Загружает веса. Пустой путь или ошибка - поиск оценивает позиции
+    // evaluate_giveaway, как без сети. Возвращает true, если сеть подключена.
+    bool nnue_load(const std::string& path);
+    bool nnue_enabled();
+
+    // Внутреннее для поиска
+    extern NNUE_Weights nnue_weights;
+    extern bool nnue_active;
+
+    void nnue_refresh(const Bitboard& board, NNUE_Accumulator& acc);
+    bool nnue_matches(const NNUE_Accumulator& acc, const Bitboard& board); // для отладочной сверки
+    int nnue_evaluate(const NNUE_Accumulator& acc, int color_to_move);
+
+    inline int nnue_feature(int perspective, int piece_color, bool king, int square) {
+        int kind = (king ? 2 : 0) + (piece_color == perspective + 1 ? 0 : 1);
+        return kind * 32 + (perspective == 0 ? square : 31 - square);
+    }
+
+#if defined(NNUE_AVX2_KERNELS)
+    extern bool nnue_cpu_avx2; // процессор поддерживает AVX2 (определяется при старте)
+
+    // В сборке под AVX2 (-march=native) проверки нет вовсе
+    inline bool nnue_use_avx2() {
+#if defined(__AVX2__)
+        return true;
+#else
+        return nnue_cpu_avx2;
+#endif
+    }
+
+    // out = in - сумма строк removed + сумма строк added (одна перспектива)
+    NNUE_AVX2_TARGET inline void nnue_update_values_avx2(const int16_t* in, int16_t* out, const int* added,
+                                                         int added_count, const int* removed, int removed_count) {
+        constexpr int REGS = NNUE_HIDDEN / 16;
+        __m256i regs[REGS];
+        for (int r = 0; r < REGS; ++r) regs[r] = _mm256_load_si256((const __m256i*)in + r);
+        for (int i = 0; i < removed_count; ++i) {
+            const __m256i* w = (const __m256i*)nnue_weights.ft_weights[removed[i]];
+            for (int r = 0; r < REGS; ++r) regs[r] = _mm256_sub_epi16(regs[r], _mm256_load_si256(w + r));
+        }
+        for (int i = 0; i < added_count; ++i) {
+            const __m256i* w = (const __m256i*)nnue_weights.ft_weights[added[i]];
+            for (int r = 0; r < REGS; ++r) regs[r] = _mm256_add_epi16(regs[r], _mm256_load_si256(w + r));
+        }
+        for (int r = 0; r < REGS; ++r) _mm256_store_si256((__m256i*)out + r, regs[r]);
+    }
+#endif
+
+    inline void nnue_update_values_scalar(const int16_t* in, int16_t* out, const int* added, int added_count,
+                                          const int* removed, int removed_count) {
+        std::memcpy(out, in, sizeof(int16_t) * NNUE_HIDDEN);
+        for (int i = 0; i < removed_count; ++i) {
+            const int16_t* w = nnue_weights.ft_weights[removed[i]];
+            for (int j = 0; j < NNUE_HIDDEN; ++j) out[j] -= w[j];
+        }
+        for (int i = 0; i < added_count; ++i) {
+            const int16_t* w = nnue_weights.ft_weights[added[i]];
+            for (int j = 0; j < NNUE_HIDDEN; ++j) out[j] += w[j];
+        }
+    }
+
+    inline void nnue_update_values(const int16_t* in, int16_t* out, const int* added, int added_count,
+                                   const int* removed, int removed_count) {
+#if defined(NNUE_AVX2_KERNELS)
+        if (nnue_use_avx2()) {
+            nnue_update_values_avx2(in, out, added, added_count, removed, removed_count);
+            return;
+        }
+#endif
+        nnue_update_values_scalar(in, out, added, added_count, removed, removed_count);
+    }
+
+    // Аккумулятор позиции после хода m стороны color из позиции b (b - позиция до хода)
+    inline void nnue_apply_move(const NNUE_Accumulator& parent, NNUE_Accumulator& child,
+                                const Bitboard& b, const Move& m, int color) {
+        bool was_king = (b.kings & m.mask_from) != 0;
+        int from = __builtin_ctzll(m.mask_from);
+        int to = __builtin_ctzll(m.mask_to);
+        for (int p = 0; p < 2; ++p) {
+            int added[1], removed[1 + 32];
+            int removed_count = 0;
+            added[0] = nnue_feature(p, color, was_king || m.becomes_king, to);
+            removed[removed_count++] = nnue_feature(p, color, was_king, from);
+            for (u64 captured = m.captured_pieces; captured; captured &= captured - 1) {
+                int sq = __builtin_ctzll(captured);
+                removed[removed_count++] = nnue_feature(p, 3 - color, (b.kings >> sq) & 1, sq);
+            }
+            nnue_update_values(parent.values[p], child.values[p], added, 1, removed, removed_count);
+        }
+    }
+}
@@ -0,0 +1,388 @@
+#include "KestoG_Tablebase.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define popcount __builtin_popcountll
+
+namespace kestog_core {
+
+    // =================================================================================
+    // >>>>> ИНДЕКСАЦИЯ <<<<<
+    // Позиция раскладывается на четыре группы: белые простые (поля 0..27 - на последнем
+    // ряду они уже дамки), чёрные простые (4..31), белые дамки и чёрные дамки (0..31).
+    // Каждая группа нумеруется комбинаторной системой счисления, индекс позиции -
+    // смешанное число из номеров групп и стороны на ходу. Наложения фигур дают
+    // "пустые" индексы; они помечаются ничьей и в поиске не встречаются.
+    // =================================================================================
+    constexpr int TB_FILE_VERSION = 1;
+
+    struct TB_FileHeader {
+        char magic[8];  // "KESTOGTB"
+        uint32_t version;
+        uint32_t material[4]; // wm, wk, bm, bk
+        uint64_t positions;
+    };
+
+    struct TB_Slice {
+        int material[4]; // wm, wk, bm, bk
+        uint64_t positions;
+        uint64_t group_size[4];
+        const uint8_t* data = nullptr; // упакованные значения (по 2 бита)
+        void* mapping = nullptr;
+        size_t mapping_size = 0;
+    };
+
+    struct TB_Group {
+        int base;   // первое допустимое поле группы
+        int range;  // число допустимых полей
+    };
+    const TB_Group TB_GROUPS[4] = {{0, 28}, {0, 32}, {4, 28}, {0, 32}}; // wm, wk, bm, bk
+
+    uint64_t BINOMIAL[33][TB_PIECES_LIMIT + 1];
+
+    std::unique_ptr<TB_Slice> tb_slices[TB_PIECES_LIMIT + 1][TB_PIECES_LIMIT + 1][TB_PIECES_LIMIT + 1][TB_PIECES_LIMIT + 1];
+    int tb_complete_pieces = 0;
+
+    void init_binomials() {
+        for (int n = 0; n <= 32; ++n) {
+            for (int k = 0; k <= TB_PIECES_LIMIT; ++k) {
+                BINOMIAL[n][k] = (k == 0) ? 1 : (n == 0) ? 0 : BINOMIAL[n - 1][k - 1] + BINOMIAL[n - 1][k];
+            }
+        }
+    }
+
+    inline uint64_t rank_group(u64 squares, int base) {
+        uint64_t rank = 0;
+        int i = 1;
+        for (; squares; squares &= squares - 1, ++i) {
+            rank += BINOMIAL[__builtin_ctzll(squares) - base][i];
+        }
+        return rank;
+    }
+
+    inline u64 unrank_group(uint64_t rank, int count, int base, int range) {
+        u64 squares = 0;
+        int c = range - 1;
+        for (int i = count; i >= 1; --i) {
+            while (BINOMIAL[c][i] > rank) --c;
+            squares |= 1ULL << (base + c);
+            rank -= BINOMIAL[c][i];
+            --c;
+        }
+        return squares;
+    }
+
+    inline void material_of(const Bitboard& b, int material[4]) {
+        material[0] = popcount(b.white_men & ~b.kings);
+        material[1] = popcount(b.white_men & b.kings);
+        material[2] = popcount(b.black_men & ~b.kings);
+        material[3] = popcount(b.black_men & b.kings);
+    }
+
+    inline TB_Slice* find_slice(const int material[4]) {
+        for (int i = 0; i < 4; ++i) {
+            if (material[i] > TB_PIECES_LIMIT) return nullptr;
+        }
+        return tb_slices[material[0]][material[1]][material[2]][material[3]].get();
+    }
+
+    void init_slice_sizes(TB_Slice& slice) {
+        slice.positions = 2;
+        for (int g = 0; g < 4; ++g) {
+            slice.group_size[g] = BINOMIAL[TB_GROUPS[g].range][slice.material[g]];
+            slice.positions *= slice.group_size[g];
+        }
+    }
+
+    inline uint64_t slice_index(const TB_Slice& slice, const Bitboard& b, int color_to_move) {
+        u64 groups[4] = {b.white_men & ~b.kings, b.white_men & b.kings, b.black_men & ~b.kings, b.black_men & b.kings};
+        uint64_t index = 0;
+        for (int g = 0; g < 4; ++g) {
+            index = index * slice.group_size[g] + rank_group(groups[g], TB_GROUPS[g].base);
+        }
+        return index * 2 + (color_to_move - 1);
+    }
+
+    // false для "пустого" индекса с наложением фигур
+    inline bool slice_position(const TB_Slice& slice, uint64_t index, Bitboard& b, int& color_to_move) {
+        color_to_move = 1 + (int)(index & 1);
+        index >>= 1;
+        u64 groups[4];
+        for (int g = 3; g >= 0; --g) {
+            groups[g] = unrank_group(index % slice.group_size[g], slice.material[g], TB_GROUPS[g].base, TB_GROUPS[g].range);
+            index /= slice.group_size[g];
+        }
+        if (popcount(groups[0] | groups[1] | groups[2] | groups[3]) !=
+            slice.material[0] + slice.material[1] + slice.material[2] + slice.material[3]) {
+            return false;
+        }
+        b.white_men = groups[0] | groups[1];
+        b.black_men = groups[2] | groups[3];
+        b.kings = groups[1] | groups[3];
+        b.hash = 0; // хеш при анализе не нужен
+        return true;
+    }
+
+    inline int packed_value(const uint8_t* data, uint64_t index) {
+        return (data[index >> 2] >> ((index & 3) * 2)) & 3;
+    }
+
+    // =================================================================================
+    // >>>>> ФАЙЛЫ И ПРОБА <<<<<
+    // =================================================================================
+    std::string slice_file_name(const std::string& dir, const int material[4]) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "kestog_%d%d%d%d.ktb", material[0], material[1], material[2], material[3]);
+        return dir.empty() ? name : dir + "/" + name;
+    }
+
+    // Отображает файл таблицы в память; при несовпадении заголовка возвращает false
+    bool map_slice_file(const std::string& path, TB_Slice& slice) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        size_t data_size = (slice.positions + 3) / 4;
+        size_t file_size = sizeof(TB_FileHeader) + data_size;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size != file_size) {
+            close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return false;
+        const TB_FileHeader* header = static_cast<const TB_FileHeader*>(mapping);
+        bool valid = std::memcmp(header->magic, "KESTOGTB", 8) == 0 && header->version == TB_FILE_VERSION &&
+                     header->positions == slice.positions;
+        for (int i = 0; i < 4; ++i) valid = valid && (int)header->material[i] == slice.material[i];
+        if (!valid) {
+            munmap(mapping, file_size);
+            return false;
+        }
+        slice.mapping = mapping;
+        slice.mapping_size = file_size;
+        slice.data = static_cast<const uint8_t*>(mapping) + sizeof(TB_FileHeader);
+        return true;
+    }
+
+    void release_slice(std::unique_ptr<TB_Slice>& cell) {
+        if (cell && cell->mapping) munmap(cell->mapping, cell->mapping_size);
+        cell.reset();
+    }
+
+    bool load_slice(const std::string& dir, const int material[4]) {
+        std::unique_ptr<TB_Slice> slice(new TB_Slice());
+        std::memcpy(slice->material, material, sizeof(slice->material));
+        init_slice_sizes(*slice);
+        if (!map_slice_file(slice_file_name(dir, material), *slice)) return false;
+        auto& cell = tb_slices[material[0]][material[1]][material[2]][material[3]];
+        release_slice(cell);
+        cell = std::move(slice);
+        return true;
+    }
+
+    // Все наборы материала с данным числом фигур, у обеих сторон есть хотя бы одна.
+    // Внутри одного числа фигур порядок - по числу простых: превращение уменьшает
+    // число простых, поэтому таблица-приемник к этому моменту уже построена.
+    std::vector<std::vector<int>> materials_with(int pieces) {
+        std::vector<std::vector<int>> result;
+        for (int men = 0; men <= pieces; ++men) {
+            for (int wm = 0; wm <= men; ++wm) {
+                int bm = men - wm;
+                for (int wk = 0; wk <= pieces - men; ++wk) {
+                    int bk = pieces - men - wk;
+                    if (wm + wk == 0 || bm + bk == 0) continue;
+                    result.push_back({wm, wk, bm, bk});
+                }
+            }
+        }
+        return result;
+    }
+
+    int update_complete_pieces() {
+        tb_complete_pieces = 0;
+        for (int pieces = 2; pieces <= TB_PIECES_LIMIT; ++pieces) {
+            for (const auto& m : materials_with(pieces)) {
+                if (!find_slice(m.data()) || !find_slice(m.data())->data) return tb_complete_pieces;
+            }
+            tb_complete_pieces = pieces;
+        }
+        return tb_complete_pieces;
+    }
+
+    // Отключает все подключённые таблицы (как book_init - старую книгу)
+    void release_tablebases() {
+        for (auto& by_wm : tb_slices) {
+            for (auto& by_wk : by_wm) {
+                for (auto& by_bm : by_wk) {
+                    for (auto& cell : by_bm) release_slice(cell);
+                }
+            }
+        }
+        tb_complete_pieces = 0;
+    }
+
+    int tb_init(const std::string& dir) {
+        release_tablebases();
+        init_binomials();
+        for (int pieces = 2; pieces <= TB_PIECES_LIMIT; ++pieces) {
+            for (const auto& m : materials_with(pieces)) load_slice(dir, m.data());
+        }
+        return update_complete_pieces();
+    }
+
+    int tb_max_pieces() {
+        return tb_complete_pieces;
+    }
+
+    int tb_probe(const Bitboard& board, int color_to_move) {
+        int material[4];
+        material_of(board, material);
+        if (material[0] + material[1] == 0 || material[2] + material[3] == 0) {
+            // Сторона без фигур ходить не может, а в поддавках это победа
+            u64 my_pieces = (color_to_move == 1) ? board.white_men : board.black_men;
+            return my_pieces ? TB_UNKNOWN : TB_WIN;
+        }
+        // Простая на последнем ряду (доска не из генератора ходов) в индекс не попадает
+        if ((board.white_men & ~board.kings & 0xF0000000ULL) || (board.black_men & ~board.kings & 0xFULL)) {
+            return TB_UNKNOWN;
+        }
+        const TB_Slice* slice = find_slice(material);
+        if (!slice || !slice->data) return TB_UNKNOWN;
+        return packed_value(slice->data, slice_index(*slice, board, color_to_move));
+    }
+
+    // =================================================================================
+    // >>>>> ГЕНЕРАЦИЯ <<<<<
+    // Ретроградный анализ прямыми проходами: позиция без ходов - победа; если есть ход
+    // в проигрыш соперника - победа; если все ходы ведут в победу соперника - проигрыш.
+    // Ходы со взятием или превращением уводят в уже построенные таблицы. Проходы по
+    // таблице повторяются, пока что-то меняется; оставшиеся позиции - ничьи.
+    // Значения монотонны (UNKNOWN -> итог), поэтому потоки пишут в общий массив
+    // атомарных байтов без блокировок.
+    // =================================================================================
+    template <typename Fn>
+    void parallel_for(uint64_t count, int num_threads, Fn fn) {
+        std::vector<std::thread> workers;
+        uint64_t chunk = (count + num_threads - 1) / num_threads;
+        for (int t = 0; t < num_threads; ++t) {
+            uint64_t begin = t * chunk, end = std::min(count, begin + chunk);
+            if (begin >= end) break;
+            workers.emplace_back([=]() { fn(begin, end); });
+        }
+        for (auto& w : workers) w.join();
+    }
+
+    // Исход позиции для стороны на ходу по уже известным исходам её преемников
+    int resolve_position(const TB_Slice& slice, const std::atomic<uint8_t>* values, const Bitboard& b, int color) {
+        MoveList moves;
+        generate_legal_moves(b, color, moves);
+        if (moves.empty()) return TB_WIN;
+        bool all_moves_lose = true;
+        for (const auto& move : moves) {
+            Bitboard next = apply_move(b, move, color);
+            int next_material[4];
+            material_of(next, next_material);
+            int value;
+            if (std::memcmp(next_material, slice.material, sizeof(next_material)) == 0) {
+                value = values[slice_index(slice, next, 3 - color)].load(std::memory_order_relaxed);
+            } else {
+                value = tb_probe(next, 3 - color); // таблица меньшего материала уже построена
+            }
+            if (value == TB_LOSS) return TB_WIN;
+            if (value != TB_WIN) all_moves_lose = false;
+        }
+        return all_moves_lose ? TB_LOSS : TB_UNKNOWN;
+    }
+
+    bool generate_slice(const std::string& dir, const int material[4], int num_threads) {
+        TB_Slice slice;
+        std::memcpy(slice.material, material, sizeof(slice.material));
+        init_slice_sizes(slice);
+        std::unique_ptr<std::atomic<uint8_t>[]> values(new std::atomic<uint8_t>[slice.positions]);
+        std::unique_ptr<uint8_t[]> valid(new uint8_t[slice.positions]);
+
+        // Сначала все значения инициализируются: проход разрешения читает и индексы
+        // других потоков, и индексы впереди себя
+        parallel_for(slice.positions, num_threads, [&](uint64_t begin, uint64_t end) {
+            for (uint64_t index = begin; index < end; ++index) {
+                Bitboard b;
+                int color;
+                valid[index] = slice_position(slice, index, b, color);
+                values[index].store(valid[index] ? TB_UNKNOWN : TB_DRAW, std::memory_order_relaxed);
+            }
+        });
+
+        std::atomic<bool> changed{true};
+        while (changed.load()) {
+            changed.store(false);
+            parallel_for(slice.positions, num_threads, [&](uint64_t begin, uint64_t end) {
+                bool local_changed = false;
+                for (uint64_t index = begin; index < end; ++index) {
+                    if (!valid[index] || values[index].load(std::memory_order_relaxed) != TB_UNKNOWN) continue;
+                    Bitboard b;
+                    int color;
+                    slice_position(slice, index, b, color);
+                    int value = resolve_position(slice, values.get(), b, color);
+                    if (value != TB_UNKNOWN) {
+                        values[index].store((uint8_t)value, std::memory_order_relaxed);
+                        local_changed = true;
+                    }
+                }
+                if (local_changed) changed.store(true);
+            });
+        }
+
+        TB_FileHeader header{};
+        std::memcpy(header.magic, "KESTOGTB", 8);
+        header.version = TB_FILE_VERSION;
+        for (int i = 0; i < 4; ++i) header.material[i] = material[i];
+        header.positions = slice.positions;
+        std::vector<uint8_t> packed((slice.positions + 3) / 4, 0);
+        for (uint64_t index = 0; index < slice.positions; ++index) {
+            int value = values[index].load(std::memory_order_relaxed);
+            if (value == TB_UNKNOWN) value = TB_DRAW;
+            packed[index >> 2] |= (uint8_t)(value << ((index & 3) * 2));
+        }
+        std::string path = slice_file_name(dir, material);
+        FILE* out = std::fopen(path.c_str(), "wb");
+        if (!out) return false;
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  std::fwrite(packed.data(), 1, packed.size(), out) == packed.size();
+        ok = (std::fclose(out) == 0) && ok;
+        return ok && load_slice(dir, material);
+    }
+
+    int tb_generate(const std::string& dir, int max_pieces, int num_threads) {
+        init_binomials();
+        max_pieces = std::min(max_pieces, TB_PIECES_LIMIT);
+        num_threads = std::max(1, num_threads);
+        int generated = 0;
+        for (int pieces = 2; pieces <= max_pieces; ++pieces) {
+            for (const auto& m : materials_with(pieces)) {
+                if (load_slice(dir, m.data())) continue;
+                auto start = std::chrono::steady_clock::now();
+                if (!generate_slice(dir, m.data(), num_threads)) {
+                    std::cerr << "TB: cannot write " << slice_file_name(dir, m.data()) << std::endl;
+                    update_complete_pieces();
+                    return -1;
+                }
+                ++generated;
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "TB " << slice_file_name(dir, m.data()) << ": "
+                          << find_slice(m.data())->positions << " positions, " << seconds << " s" << std::endl;
+            }
+        }
+        update_complete_pieces();
+        return generated;
+    }
+}
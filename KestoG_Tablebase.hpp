@@ -0,0 +1,29 @@
+#pragma once
+#include "KestoG_Core.hpp"
+#include <string>
+
+namespace kestog_core {
+
+    // --- Эндшпильные таблицы (WDL) для поддавков ---
+    // Таблица строится на каждый набор материала (простые/дамки каждой стороны) и хранит
+    // исход для стороны на ходу: 2 бита на позицию, 4 позиции в байте. Файлы таблиц
+    // отображаются в память при загрузке, так что проба - это одно чтение байта.
+    enum TB_VALUE { TB_UNKNOWN = 0, TB_WIN = 1, TB_LOSS = 2, TB_DRAW = 3 };
+
+    constexpr int TB_PIECES_LIMIT = 8; // больше фигур индексная схема не поддерживает
+
+    // Строит недостающие таблицы до max_pieces фигур включительно в каталоге dir
+    // ретроградным анализом на num_threads потоках и сразу подключает их к пробе.
+    // Требует init_engine. Возвращает число построенных таблиц (-1 при ошибке записи).
+    int tb_generate(const std::string& dir, int max_pieces, int num_threads);
+
+    // Подключает (mmap) все таблицы из каталога вместо ранее подключённых. Возвращает
+    // число фигур, до которого включительно набор таблиц полон (0, если таблиц нет).
+    int tb_init(const std::string& dir);
+
+    // Исход для стороны на ходу или TB_UNKNOWN, если таблицы для этого материала нет
+    int tb_probe(const Bitboard& board, int color_to_move);
+
+    // Число фигур, начиная с которого (и ниже) поиск обращается к таблицам
+    int tb_max_pieces();
+}
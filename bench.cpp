@@ -0,0 +1,168 @@
+// bench.cpp
+// Бенчмарк поиска на фиксированном наборе позиций поддавков.
+//
+//   kestog_bench [--depth N] [--time MS] [--tt MB] [--threads N] [--tb DIR] [--nnue FILE] [--json PATH]
+//                [--no-aspiration] [--no-pvs] [--no-lmr]
+//
+// Для каждой позиции ТТ очищается, затем find_best_move ищет до глубины N.
+// Печатается краткая таблица, а полный отчёт (узлы, NPS, время до каждой глубины,
+// доля попаданий и заполненность ТТ, эффективный коэффициент ветвления) пишется в JSON:
+// в файл PATH или, если PATH = "-", в stdout. С --tb поиск пробует эндшпильные таблицы из DIR,
+// с --nnue оценивает позиции нейросетью с весами из FILE.
+// Ключи --no-* отключают отдельные техники поиска, чтобы замерить их вклад.
+// В сборке с KESTOG_STATS после таблицы печатаются счётчики поиска по всем позициям.
+
+#include "KestoG_Core.hpp"
+#include "KestoG_Tablebase.hpp"
+#include "KestoG_NNUE.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace kestog_core;
+
+namespace {
+    struct BenchPosition {
+        const char* name;
+        Bitboard board;
+        int color_to_move;
+    };
+
+    // Позиции получены случайными партиями из начальной расстановки с фиксированным seed
+    const BenchPosition BENCH_POSITIONS[] = {
+        {"start",          {0x00000fffULL, 0xfff00000ULL, 0x00000000ULL, 0}, 1},
+        {"opening_ply8",   {0x00009afdULL, 0xfbd20000ULL, 0x00000000ULL, 0}, 1},
+        {"opening_ply14",  {0x00009f3bULL, 0xf4f00000ULL, 0x00000000ULL, 0}, 1},
+        {"middle_ply20",   {0x00002d3eULL, 0x97d10000ULL, 0x00000000ULL, 0}, 1},
+        {"middle_ply26",   {0x00081c8dULL, 0x1c900000ULL, 0x00000000ULL, 0}, 1},
+        {"middle_king",    {0x800045beULL, 0x55390000ULL, 0x80000000ULL, 0}, 1},
+        {"late_ply32",     {0x0000ca73ULL, 0x08100000ULL, 0x00000000ULL, 0}, 1},
+        {"late_ply40",     {0x080808a1ULL, 0x16320000ULL, 0x00000000ULL, 0}, 1},
+        {"kings_mixed",    {0x00002261ULL, 0x84340000ULL, 0x80042001ULL, 0}, 1},
+    };
+
+    // Эффективный коэффициент ветвления: среднее геометрическое отношения узлов
+    // соседних итераций (узлы итерации = прирост счётчика главного потока)
+    double effective_branching_factor(const std::vector<IterationInfo>& iterations) {
+        if (iterations.size() < 2) return 0;
+        long long first = iterations[0].nodes;
+        long long last = iterations.back().nodes - iterations[iterations.size() - 2].nodes;
+        if (first <= 0 || last <= 0) return 0;
+        return std::pow((double)last / first, 1.0 / (iterations.size() - 1));
+    }
+
+    double nps(long long nodes, double time_ms) {
+        return time_ms > 0 ? nodes * 1000.0 / time_ms : 0;
+    }
+
+    void print_stats(FILE* out, const SearchStats& s) {
+        auto share = [](long long part, long long whole) { return whole ? 100.0 * part / whole : 0.0; };
+        std::fprintf(out, "\nstats: nodes %lld  qnodes %.1f%%  tt hits %.1f%%  tt cutoffs exact %lld alpha %lld beta %lld\n",
+                     s.nodes, share(s.qnodes, s.nodes), share(s.tt_hits, s.tt_probes),
+                     s.tt_cutoffs_exact, s.tt_cutoffs_alpha, s.tt_cutoffs_beta);
+        std::fprintf(out, "stats: beta cutoffs %lld by move index:", s.beta_cutoffs);
+        for (int i = 0; i < STATS_CUTOFF_BUCKETS; ++i) {
+            std::fprintf(out, " %s%d %.1f%%", i + 1 == STATS_CUTOFF_BUCKETS ? ">=" : "", i, share(s.beta_cutoff_index[i], s.beta_cutoffs));
+        }
+        std::fprintf(out, "\nstats: capture chain %.2f (king %.2f, %lld king captures)  movegen %.1f ms  eval %.1f ms\n",
+                     s.capture_moves ? (double)s.capture_chain_pieces / s.capture_moves : 0.0,
+                     s.king_capture_moves ? (double)s.king_chain_pieces / s.king_capture_moves : 0.0,
+                     s.king_capture_moves, s.movegen_ns / 1e6, s.eval_ns / 1e6);
+    }
+
+    void write_json(FILE* out, const std::vector<SearchResult>& results, int depth, int tt_mb, int threads,
+                    const SearchOptions& options) {
+        long long total_nodes = 0, total_probes = 0, total_hits = 0;
+        double total_time = 0;
+        std::fprintf(out, "{\n  \"depth\": %d,\n  \"tt_size_mb\": %d,\n  \"threads\": %d,\n"
+                          "  \"options\": {\"aspiration\": %s, \"pvs\": %s, \"lmr\": %s, \"nnue\": %s},\n  \"positions\": [\n",
+                     depth, tt_mb, threads, options.aspiration ? "true" : "false", options.pvs ? "true" : "false",
+                     options.lmr ? "true" : "false", nnue_enabled() ? "true" : "false");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const SearchResult& r = results[i];
+            total_nodes += r.nodes_searched;
+            total_probes += r.tt_probes;
+            total_hits += r.tt_hits;
+            total_time += r.time_taken_ms;
+            std::fprintf(out, "    {\"name\": \"%s\", \"final_depth\": %d, \"score\": %d, \"nodes\": %lld, "
+                              "\"time_ms\": %.3f, \"nps\": %.0f, \"tt_hit_rate\": %.4f, \"tt_hashfull\": %d, \"tb_hits\": %lld, \"ebf\": %.3f, "
+                              "\"best_move\": [%d, %d], \"iterations\": [",
+                         BENCH_POSITIONS[i].name, r.final_depth, r.score, r.nodes_searched, r.time_taken_ms,
+                         nps(r.nodes_searched, r.time_taken_ms),
+                         r.tt_probes ? (double)r.tt_hits / r.tt_probes : 0.0, r.tt_hashfull, r.tb_hits,
+                         effective_branching_factor(r.iterations),
+                         r.best_move.mask_from ? __builtin_ctzll(r.best_move.mask_from) : -1,
+                         r.best_move.mask_to ? __builtin_ctzll(r.best_move.mask_to) : -1);
+            for (size_t j = 0; j < r.iterations.size(); ++j) {
+                const IterationInfo& it = r.iterations[j];
+                std::fprintf(out, "%s{\"depth\": %d, \"score\": %d, \"nodes\": %lld, \"time_ms\": %.3f}",
+                             j ? ", " : "", it.depth, it.score, it.nodes, it.time_ms);
+            }
+            std::fprintf(out, "]}%s\n", i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ],\n  \"total\": {\"nodes\": %lld, \"time_ms\": %.3f, \"nps\": %.0f, \"tt_hit_rate\": %.4f}\n}\n",
+                     total_nodes, total_time, nps(total_nodes, total_time),
+                     total_probes ? (double)total_hits / total_probes : 0.0);
+    }
+}
+
+int main(int argc, char** argv) {
+    int depth = 14;
+    int time_limit_ms = 600000;
+    int tt_mb = 64;
+    int threads = 1;
+    const char* json_path = nullptr;
+    const char* tb_dir = nullptr;
+    const char* nnue_path = "";
+    SearchOptions options;
+    options.time_management = false; // каждая позиция ищется ровно до глубины N
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--depth") && has_value) depth = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--time") && has_value) time_limit_ms = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--tt") && has_value) tt_mb = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threads") && has_value) threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--tb") && has_value) tb_dir = argv[++i];
+        else if (!std::strcmp(argv[i], "--nnue") && has_value) nnue_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--json") && has_value) json_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--no-aspiration")) options.aspiration = false;
+        else if (!std::strcmp(argv[i], "--no-pvs")) options.pvs = false;
+        else if (!std::strcmp(argv[i], "--no-lmr")) options.lmr = false;
+        else {
+            std::fprintf(stderr, "usage: %s [--depth N] [--time MS] [--tt MB] [--threads N] [--tb DIR] [--nnue FILE] [--json PATH|-]\n"
+                                 "       [--no-aspiration] [--no-pvs] [--no-lmr]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    set_info_output(false);
+    init_engine(tt_mb, threads, "", nnue_path);
+    set_search_options(options);
+    if (tb_dir) std::fprintf(stderr, "tablebases: up to %d pieces\n", tb_init(tb_dir));
+    if (*nnue_path) std::fprintf(stderr, "nnue: %s\n", nnue_enabled() ? "loaded" : "failed, built-in evaluation");
+    // Таблица идёт в stderr, если JSON пишется в stdout
+    FILE* table = (json_path && !std::strcmp(json_path, "-")) ? stderr : stdout;
+
+    std::vector<SearchResult> results;
+    for (const auto& pos : BENCH_POSITIONS) {
+        clear_transposition_table();
+        SearchResult r = find_best_move(pos.board, pos.color_to_move, depth, time_limit_ms);
+        std::fprintf(table, "%-14s depth %2d  nodes %10lld  %9.1f ms  %8.0f nps  tt hits %5.1f%%  ebf %.2f\n",
+                     pos.name, r.final_depth, r.nodes_searched, r.time_taken_ms, nps(r.nodes_searched, r.time_taken_ms),
+                     r.tt_probes ? 100.0 * r.tt_hits / r.tt_probes : 0.0, effective_branching_factor(r.iterations));
+        results.push_back(r);
+    }
+    if (search_stats_enabled()) print_stats(table, get_search_stats());
+
+    if (json_path) {
+        FILE* out = std::strcmp(json_path, "-") ? std::fopen(json_path, "w") : stdout;
+        if (!out) {
+            std::perror(json_path);
+            return 1;
+        }
+        write_json(out, results, depth, tt_mb, threads, options);
+        if (out != stdout) std::fclose(out);
+    }
+    return 0;
+}
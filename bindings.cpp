@@ -1,9 +1,39 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include "KestoG_Core.hpp"
+#include "KestoG_Tablebase.hpp"
+#include "KestoG_NNUE.hpp"
+#include "KestoG_Book.hpp"
 
 namespace py = pybind11;
 
+// Колбэк хода поиска вызывается из потока поиска, поэтому GIL берётся только на время
+// вызова. Сам объект Python живёт в shared_ptr с удалителем под GIL: последняя копия
+// колбэка может разрушиться в потоке без GIL.
+kestog_core::ProgressCallback wrap_progress_callback(const py::object& callback) {
+    if (callback.is_none()) return nullptr;
+    std::shared_ptr<py::object> fn(new py::object(callback), [](py::object* p) {
+        py::gil_scoped_acquire gil;
+        delete p;
+    });
+    return [fn](const kestog_core::SearchProgress& progress) {
+        py::gil_scoped_acquire gil;
+        try {
+            (*fn)(progress);
+        } catch (py::error_already_set& e) {
+            // Исключение колбэка не должно уронить поток поиска
+            e.discard_as_unraisable("kestog_core search progress callback");
+        }
+    };
+}
+
+// Структурные dtype NumPy поверх плоских записей пакетного анализа
+PYBIND11_NUMPY_DTYPE(kestog_core::BatchPosition, white_men, black_men, kings, color_to_move);
+PYBIND11_NUMPY_DTYPE(kestog_core::BatchResult, mask_from, mask_to, captured_pieces, nodes, time_ms, score,
+                     final_depth, becomes_king);
+PYBIND11_NUMPY_DTYPE(kestog_core::SelfPlayRecord, white_men, black_men, kings, score, result, color_to_move);
+
 PYBIND11_MODULE(kestog_core, m) {
     m.doc() = "High-performance giveaway checkers core module v2.0 with advanced search";
 
@@ -21,19 +51,288 @@ PYBIND11_MODULE(kestog_core, m) {
         .def_readwrite("captured_pieces", &kestog_core::Move::captured_pieces)
         .def_readwrite("becomes_king", &kestog_core::Move::becomes_king);
 
+    py::class_<kestog_core::IterationInfo>(m, "IterationInfo")
+        .def_readonly("depth", &kestog_core::IterationInfo::depth)
+        .def_readonly("score", &kestog_core::IterationInfo::score)
+        .def_readonly("nodes", &kestog_core::IterationInfo::nodes)
+        .def_readonly("time_ms", &kestog_core::IterationInfo::time_ms);
+
+    py::class_<kestog_core::PVLine>(m, "PVLine")
+        .def_readonly("move", &kestog_core::PVLine::move)
+        .def_readonly("score", &kestog_core::PVLine::score)
+        .def_readonly("pv", &kestog_core::PVLine::pv);
+
+    // Счётчики профилирования; в сборке без KESTOG_STATS все поля нулевые
+    py::class_<kestog_core::SearchStats>(m, "SearchStats")
+        .def(py::init<>())
+        .def_readonly("nodes", &kestog_core::SearchStats::nodes)
+        .def_readonly("qnodes", &kestog_core::SearchStats::qnodes)
+        .def_readonly("tt_probes", &kestog_core::SearchStats::tt_probes)
+        .def_readonly("tt_hits", &kestog_core::SearchStats::tt_hits)
+        .def_readonly("tt_cutoffs_exact", &kestog_core::SearchStats::tt_cutoffs_exact)
+        .def_readonly("tt_cutoffs_alpha", &kestog_core::SearchStats::tt_cutoffs_alpha)
+        .def_readonly("tt_cutoffs_beta", &kestog_core::SearchStats::tt_cutoffs_beta)
+        .def_readonly("beta_cutoffs", &kestog_core::SearchStats::beta_cutoffs)
+        .def_property_readonly("beta_cutoff_index", [](const kestog_core::SearchStats& s) {
+            return std::vector<long long>(s.beta_cutoff_index, s.beta_cutoff_index + kestog_core::STATS_CUTOFF_BUCKETS);
+        }, "Beta cutoffs by move index in the ordered list; the last bucket counts all later moves.")
+        .def_readonly("capture_moves", &kestog_core::SearchStats::capture_moves)
+        .def_readonly("capture_chain_pieces", &kestog_core::SearchStats::capture_chain_pieces)
+        .def_readonly("king_capture_moves", &kestog_core::SearchStats::king_capture_moves)
+        .def_readonly("king_chain_pieces", &kestog_core::SearchStats::king_chain_pieces)
+        .def_readonly("movegen_ns", &kestog_core::SearchStats::movegen_ns)
+        .def_readonly("eval_ns", &kestog_core::SearchStats::eval_ns)
+        .def_property_readonly("qnode_share", [](const kestog_core::SearchStats& s) {
+            return s.nodes ? (double)s.qnodes / s.nodes : 0.0;
+        })
+        .def_property_readonly("first_move_cutoff_rate", [](const kestog_core::SearchStats& s) {
+            return s.beta_cutoffs ? (double)s.beta_cutoff_index[0] / s.beta_cutoffs : 0.0;
+        })
+        .def_property_readonly("avg_capture_chain", [](const kestog_core::SearchStats& s) {
+            return s.capture_moves ? (double)s.capture_chain_pieces / s.capture_moves : 0.0;
+        })
+        .def_property_readonly("avg_king_capture_chain", [](const kestog_core::SearchStats& s) {
+            return s.king_capture_moves ? (double)s.king_chain_pieces / s.king_capture_moves : 0.0;
+        });
+
     py::class_<kestog_core::SearchResult>(m, "SearchResult")
         .def(py::init<>())
         .def_readonly("best_move", &kestog_core::SearchResult::best_move)
         .def_readonly("score", &kestog_core::SearchResult::score)
         .def_readonly("nodes_searched", &kestog_core::SearchResult::nodes_searched)
         .def_readonly("time_taken_ms", &kestog_core::SearchResult::time_taken_ms)
-        .def_readonly("final_depth", &kestog_core::SearchResult::final_depth);
+        .def_readonly("final_depth", &kestog_core::SearchResult::final_depth)
+        .def_readonly("tt_probes", &kestog_core::SearchResult::tt_probes)
+        .def_readonly("tt_hits", &kestog_core::SearchResult::tt_hits)
+        .def_readonly("tt_hashfull", &kestog_core::SearchResult::tt_hashfull)
+        .def_readonly("tb_hits", &kestog_core::SearchResult::tb_hits)
+        .def_readonly("iterations", &kestog_core::SearchResult::iterations)
+        .def_readonly("pv", &kestog_core::SearchResult::pv)
+        .def_readonly("lines", &kestog_core::SearchResult::lines)
+        .def_readonly("from_book", &kestog_core::SearchResult::from_book)
+        .def_readonly("stats", &kestog_core::SearchResult::stats);
+
+    py::class_<kestog_core::SearchOptions>(m, "SearchOptions")
+        .def(py::init<>())
+        .def_readwrite("aspiration", &kestog_core::SearchOptions::aspiration)
+        .def_readwrite("aspiration_window", &kestog_core::SearchOptions::aspiration_window)
+        .def_readwrite("pvs", &kestog_core::SearchOptions::pvs)
+        .def_readwrite("lmr", &kestog_core::SearchOptions::lmr)
+        .def_readwrite("lmr_min_depth", &kestog_core::SearchOptions::lmr_min_depth)
+        .def_readwrite("lmr_full_moves", &kestog_core::SearchOptions::lmr_full_moves)
+        .def_readwrite("node_limit", &kestog_core::SearchOptions::node_limit)
+        .def_readwrite("time_management", &kestog_core::SearchOptions::time_management,
+                       "Soft time limit and instant single-move replies in find_best_move/SearchHandle. "
+                       "Off: search to max_depth within the hard limit (batch analysis always does).");
 
-    m.def("init_engine", &kestog_core::init_engine, "Initializes the engine's Zobrist keys and TT.");
-    m.def("find_best_move", &kestog_core::find_best_move, "Finds the best move using iterative deepening search.",
-          py::arg("board"), py::arg("color_to_move"), py::arg("max_depth"), py::arg("time_limit_ms"));
+    m.def("init_engine", &kestog_core::init_engine,
+          "Initializes the engine's Zobrist keys, TT and Lazy SMP thread count. "
+          "With tt_path the TT is a memory-mapped file that survives restarts. "
+          "With nnue_path positions are evaluated by the NNUE network loaded from that file.",
+          py::arg("tt_size_mb"), py::arg("num_threads") = 1, py::arg("tt_path") = "", py::arg("nnue_path") = "");
+    m.def("save_transposition_table", &kestog_core::save_transposition_table,
+          "Flushes a file-backed TT to disk. Returns False for an in-memory TT.",
+          py::call_guard<py::gil_scoped_release>());
+    m.def("clear_transposition_table", &kestog_core::clear_transposition_table, "Clears all TT entries.");
+    m.def("tt_hashfull", &kestog_core::tt_hashfull, "TT occupancy by the latest search, per mille.");
+    m.def("set_search_options", &kestog_core::set_search_options,
+          "Switches search techniques (aspiration windows, PVS, LMR) and the node limit for searches started afterwards.",
+          py::arg("options"));
+    m.def("get_search_options", &kestog_core::get_search_options, "Returns the current SearchOptions.");
+    m.def("set_info_output", &kestog_core::set_info_output, "Enables or disables 'info ...' lines on stdout.",
+          py::arg("enabled"));
+    m.def("search_stats_enabled", &kestog_core::search_stats_enabled,
+          "True if the engine was built with KESTOG_STATS and fills SearchStats.");
+    m.def("get_search_stats", &kestog_core::get_search_stats,
+          "SearchStats summed over all searches since the last reset_search_stats().");
+    m.def("reset_search_stats", &kestog_core::reset_search_stats, "Zeroes the accumulated SearchStats.");
+
+    // Поиск и генерация ходов идут без GIL, чтобы не блокировать другие потоки Python
+    py::class_<kestog_core::StopToken, std::shared_ptr<kestog_core::StopToken>>(m, "StopToken")
+        .def(py::init<>())
+        .def("request_stop", &kestog_core::StopToken::request_stop, "Asks every search using this token to stop.")
+        .def("stop_requested", &kestog_core::StopToken::stop_requested)
+        .def("reset", &kestog_core::StopToken::reset);
+
+    py::class_<kestog_core::SearchProgress>(m, "SearchProgress")
+        .def_readonly("depth", &kestog_core::SearchProgress::depth)
+        .def_readonly("multipv", &kestog_core::SearchProgress::multipv)
+        .def_readonly("score", &kestog_core::SearchProgress::score)
+        .def_readonly("nodes", &kestog_core::SearchProgress::nodes)
+        .def_readonly("time_ms", &kestog_core::SearchProgress::time_ms)
+        .def_readonly("nps", &kestog_core::SearchProgress::nps)
+        .def_readonly("pv", &kestog_core::SearchProgress::pv);
+
+    m.attr("MAX_MULTI_PV") = kestog_core::MAX_MULTI_PV;
+    m.def("find_best_move",
+          [](const kestog_core::Bitboard& board, int color_to_move, int max_depth, int time_limit_ms, int multi_pv,
+             const std::shared_ptr<kestog_core::StopToken>& stop_token, const py::object& on_progress) {
+              kestog_core::ProgressCallback callback = wrap_progress_callback(on_progress);
+              py::gil_scoped_release release;
+              return kestog_core::find_best_move(board, color_to_move, max_depth, time_limit_ms, multi_pv,
+                                                 stop_token, callback);
+          },
+          "Finds the best move using iterative deepening search. With multi_pv > 1, result.lines "
+          "holds exact scores and lines for that many best root moves. stop_token aborts the search "
+          "from any thread; on_progress(SearchProgress) is called after every iteration.",
+          py::arg("board"), py::arg("color_to_move"), py::arg("max_depth"), py::arg("time_limit_ms"),
+          py::arg("multi_pv") = 1, py::arg("stop_token") = nullptr, py::arg("on_progress") = py::none());
+
+    // Деструктор хендла дожидается потока поиска, а тот может ждать GIL в колбэке:
+    // поэтому хендл удаляется с отпущенным GIL
+    py::class_<kestog_core::SearchHandle, std::shared_ptr<kestog_core::SearchHandle>>(m, "SearchHandle")
+        .def(py::init([]() {
+            return std::shared_ptr<kestog_core::SearchHandle>(new kestog_core::SearchHandle(),
+                                                             [](kestog_core::SearchHandle* handle) {
+                                                                 py::gil_scoped_release release;
+                                                                 delete handle;
+                                                             });
+        }))
+        .def("start",
+             [](kestog_core::SearchHandle& handle, const kestog_core::Bitboard& board, int color_to_move, int max_depth,
+                int time_limit_ms, int multi_pv, const std::shared_ptr<kestog_core::StopToken>& stop_token,
+                const py::object& on_progress) {
+                 kestog_core::ProgressCallback callback = wrap_progress_callback(on_progress);
+                 py::gil_scoped_release release;
+                 handle.start(board, color_to_move, max_depth, time_limit_ms, multi_pv, stop_token, callback);
+             },
+             "Starts a search in a background thread.",
+             py::arg("board"), py::arg("color_to_move"), py::arg("max_depth"), py::arg("time_limit_ms"),
+             py::arg("multi_pv") = 1, py::arg("stop_token") = nullptr, py::arg("on_progress") = py::none())
+        .def("ponder",
+             [](kestog_core::SearchHandle& handle, const kestog_core::Bitboard& board, int color_to_move, int max_depth,
+                int time_limit_ms, int multi_pv, const std::shared_ptr<kestog_core::StopToken>& stop_token,
+                const py::object& on_progress) {
+                 kestog_core::ProgressCallback callback = wrap_progress_callback(on_progress);
+                 py::gil_scoped_release release;
+                 handle.ponder(board, color_to_move, max_depth, time_limit_ms, multi_pv, stop_token, callback);
+             },
+             "Starts pondering: searches the position after the expected reply with no time limit "
+             "until ponderhit() or stop().",
+             py::arg("board"), py::arg("color_to_move"), py::arg("max_depth"), py::arg("time_limit_ms"),
+             py::arg("multi_pv") = 1, py::arg("stop_token") = nullptr, py::arg("on_progress") = py::none())
+        .def("ponderhit", &kestog_core::SearchHandle::ponderhit,
+             "The expected reply was played: the ponder search continues as a normal timed search. "
+             "Time spent pondering counts towards time_limit_ms.")
+        .def("is_pondering", &kestog_core::SearchHandle::is_pondering, "Returns True while pondering.")
+        .def("poll", &kestog_core::SearchHandle::poll, "Returns True when the search has finished.")
+        .def("stop", &kestog_core::SearchHandle::stop, "Requests the search to stop as soon as possible.")
+        .def("result", &kestog_core::SearchHandle::result, "Waits for the search to finish and returns its result.",
+             py::call_guard<py::gil_scoped_release>());
     
-    m.def("generate_legal_moves", &kestog_core::generate_legal_moves, "Generates all legal moves for a position.");
-    m.def("apply_move", &kestog_core::apply_move, "Applies a move to the board.");
+    // Пакетный анализ: массив позиций ищется на пуле потоков за один вызов без GIL
+    m.attr("BATCH_POSITION_DTYPE") = py::dtype::of<kestog_core::BatchPosition>();
+    m.attr("BATCH_RESULT_DTYPE") = py::dtype::of<kestog_core::BatchResult>();
+    m.def("analyze_positions",
+          py::overload_cast<const std::vector<kestog_core::Bitboard>&, const std::vector<int>&, int, int, int>(
+              &kestog_core::analyze_positions),
+          "Searches each (board, color) pair independently across a worker pool. Returns a list of SearchResult. "
+          "Raises ValueError if the lists differ in length or a color is not 1 or 2.",
+          py::arg("boards"), py::arg("colors"), py::arg("max_depth"), py::arg("time_limit_ms"),
+          py::arg("num_workers") = 0, py::call_guard<py::gil_scoped_release>());
+    // Вход читается прямо из буфера массива (C-порядок, dtype BATCH_POSITION_DTYPE),
+    // результаты пишутся прямо в буфер возвращаемого массива
+    m.def("analyze_batch",
+          [](py::array_t<kestog_core::BatchPosition, py::array::c_style | py::array::forcecast> positions,
+             int max_depth, int time_limit_ms, int num_workers) {
+              if (positions.ndim() != 1) throw std::invalid_argument("positions must be a 1-D array");
+              size_t count = (size_t)positions.shape(0);
+              py::array_t<kestog_core::BatchResult> results(count);
+              const kestog_core::BatchPosition* in = positions.data();
+              kestog_core::BatchResult* out = results.mutable_data();
+              {
+                  py::gil_scoped_release release;
+                  kestog_core::analyze_positions(in, out, count, max_depth, time_limit_ms, num_workers);
+              }
+              return results;
+          },
+          "Searches a NumPy array of BATCH_POSITION_DTYPE records across a worker pool "
+          "and returns an array of BATCH_RESULT_DTYPE records. Raises ValueError if a color_to_move is not 1 or 2.",
+          py::arg("positions"), py::arg("max_depth"), py::arg("time_limit_ms"), py::arg("num_workers") = 0);
+
+    // Самоигра
+    py::class_<kestog_core::SelfPlayConfig>(m, "SelfPlayConfig")
+        .def(py::init<>())
+        .def_readwrite("games", &kestog_core::SelfPlayConfig::games)
+        .def_readwrite("nodes_per_move", &kestog_core::SelfPlayConfig::nodes_per_move)
+        .def_readwrite("random_plies", &kestog_core::SelfPlayConfig::random_plies)
+        .def_readwrite("max_plies", &kestog_core::SelfPlayConfig::max_plies)
+        .def_readwrite("num_workers", &kestog_core::SelfPlayConfig::num_workers)
+        .def_readwrite("seed", &kestog_core::SelfPlayConfig::seed);
+    py::class_<kestog_core::SelfPlayStats>(m, "SelfPlayStats")
+        .def_readonly("ok", &kestog_core::SelfPlayStats::ok)
+        .def_readonly("games", &kestog_core::SelfPlayStats::games)
+        .def_readonly("positions", &kestog_core::SelfPlayStats::positions)
+        .def_readonly("white_wins", &kestog_core::SelfPlayStats::white_wins)
+        .def_readonly("black_wins", &kestog_core::SelfPlayStats::black_wins)
+        .def_readonly("draws", &kestog_core::SelfPlayStats::draws)
+        .def_readonly("nodes", &kestog_core::SelfPlayStats::nodes)
+        .def_readonly("time_s", &kestog_core::SelfPlayStats::time_s)
+        .def_readonly("workers", &kestog_core::SelfPlayStats::workers)
+        .def_readonly("positions_per_second_per_core", &kestog_core::SelfPlayStats::positions_per_second_per_core);
+    m.attr("SELFPLAY_RECORD_DTYPE") = py::dtype::of<kestog_core::SelfPlayRecord>();
+    m.def("selfplay", &kestog_core::selfplay,
+          "Plays config.games self-play games at a fixed node count per move and appends the positions "
+          "to path as SELFPLAY_RECORD_DTYPE records. Returns SelfPlayStats.",
+          py::arg("path"), py::arg("config"), py::call_guard<py::gil_scoped_release>());
+
+    m.def("generate_legal_moves",
+          py::overload_cast<const kestog_core::Bitboard&, int>(&kestog_core::generate_legal_moves),
+          "Generates all legal moves for a position.", py::arg("board"), py::arg("color_to_move"),
+          py::call_guard<py::gil_scoped_release>());
+    // apply_move обновляет хеш инкрементально, а доски из Python обычно приходят без хеша,
+    // поэтому здесь сначала пересчитываем его с нуля.
+    m.def("apply_move", [](const kestog_core::Bitboard& board, const kestog_core::Move& move, int color_to_move) {
+              kestog_core::Bitboard src = board;
+              src.hash = kestog_core::calculate_hash(board, color_to_move);
+              return kestog_core::apply_move(src, move, color_to_move);
+          }, "Applies a move to the board.", py::arg("board"), py::arg("move"), py::arg("color_to_move"));
+    m.def("perft", &kestog_core::perft, "Counts leaf nodes of the move tree to the given depth.",
+          py::arg("board"), py::arg("color_to_move"), py::arg("depth"),
+          py::call_guard<py::gil_scoped_release>());
+    m.def("perft_divide", &kestog_core::perft_divide, "Perft split by root move: list of (move, nodes).",
+          py::arg("board"), py::arg("color_to_move"), py::arg("depth"),
+          py::call_guard<py::gil_scoped_release>());
+    // Эндшпильные таблицы
+    m.attr("TB_UNKNOWN") = (int)kestog_core::TB_UNKNOWN;
+    m.attr("TB_WIN") = (int)kestog_core::TB_WIN;
+    m.attr("TB_LOSS") = (int)kestog_core::TB_LOSS;
+    m.attr("TB_DRAW") = (int)kestog_core::TB_DRAW;
+    m.def("tb_generate", &kestog_core::tb_generate,
+          "Builds missing WDL endgame tables up to max_pieces into dir and loads them. "
+          "Returns the number of tables built, -1 on a write error.",
+          py::arg("dir"), py::arg("max_pieces"), py::arg("num_threads") = 1,
+          py::call_guard<py::gil_scoped_release>());
+    m.def("tb_init", &kestog_core::tb_init,
+          "Memory-maps the endgame tables found in dir. Returns the piece count they fully cover.",
+          py::arg("dir"), py::call_guard<py::gil_scoped_release>());
+    m.def("tb_probe", &kestog_core::tb_probe, "WDL value for the side to move (TB_*), TB_UNKNOWN without a table.",
+          py::arg("board"), py::arg("color_to_move"));
+    m.def("tb_max_pieces", &kestog_core::tb_max_pieces, "Piece count up to which the search probes the tables.");
+    // Нейросетевая оценка
+    m.def("nnue_load", &kestog_core::nnue_load,
+          "Loads NNUE weights for the evaluation. An empty path or a bad file switches back "
+          "to the built-in evaluation. Returns True if the network is in use.",
+          py::arg("path"));
+    m.def("nnue_enabled", &kestog_core::nnue_enabled, "True if positions are evaluated by the NNUE network.");
+    // Дебютная книга
+    m.def("book_build", &kestog_core::book_build,
+          "Builds an opening book by searching every position of the first plies plies to depth "
+          "across a worker pool and writes it to path. Returns the number of entries, -1 on a write error.",
+          py::arg("path"), py::arg("plies"), py::arg("depth"), py::arg("time_limit_ms"), py::arg("num_workers") = 0,
+          py::call_guard<py::gil_scoped_release>());
+    m.def("book_init", &kestog_core::book_init,
+          "Memory-maps the opening book at path (an empty path disables the book). "
+          "find_best_move and SearchHandle answer book positions without searching. Returns the entry count.",
+          py::arg("path"), py::call_guard<py::gil_scoped_release>());
+    m.def("book_probe",
+          [](const kestog_core::Bitboard& board, int color_to_move) -> py::object {
+              kestog_core::Move move;
+              int score;
+              if (!kestog_core::book_probe(board, color_to_move, move, score)) return py::none();
+              return py::make_tuple(move, score);
+          },
+          "Returns (move, score) from the opening book, or None if the position is not in it.",
+          py::arg("board"), py::arg("color_to_move"));
     m.def("calculate_hash", &kestog_core::calculate_hash, "Calculates Zobrist hash for a board state.");
 }
@@ -0,0 +1,61 @@
+// bookgen.cpp
+// Построение дебютной книги поддавков.
+//
+//   kestog_book <out_file> [--plies N] [--depth N] [--time MS] [--threads N] [--tt MB] [--tb DIR]
+//
+// Все позиции первых N полуходов от начальной расстановки ищутся на глубину --depth
+// (не дольше --time на позицию) параллельно, по позиции на поток. Книгу подключает
+// book_init (в main.py - переменная окружения KESTOG_BOOK).
+
+#include "KestoG_Core.hpp"
+#include "KestoG_Tablebase.hpp"
+#include "KestoG_Book.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace kestog_core;
+
+int main(int argc, char** argv) {
+    int plies = 6;
+    int depth = 20;
+    int time_limit_ms = 60000;
+    int threads = 0;
+    int tt_mb = 256;
+    const char* tb_dir = nullptr;
+    const char* out_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--plies") && has_value) plies = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--depth") && has_value) depth = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--time") && has_value) time_limit_ms = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threads") && has_value) threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--tt") && has_value) tt_mb = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--tb") && has_value) tb_dir = argv[++i];
+        else if (argv[i][0] != '-' && !out_path) out_path = argv[i];
+        else {
+            out_path = nullptr;
+            break;
+        }
+    }
+    if (!out_path) {
+        std::fprintf(stderr, "usage: %s <out_file> [--plies N] [--depth N] [--time MS] [--threads N] [--tt MB] [--tb DIR]\n",
+                     argv[0]);
+        return 2;
+    }
+
+    set_info_output(false);
+    init_engine(tt_mb, 1);
+    if (tb_dir) std::fprintf(stderr, "tablebases: up to %d pieces\n", tb_init(tb_dir));
+
+    auto start = std::chrono::steady_clock::now();
+    long long entries = book_build(out_path, plies, depth, time_limit_ms, threads);
+    if (entries < 0) {
+        std::fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%lld positions in %.1f s\n", entries, seconds);
+    return 0;
+}
@@ -12,6 +12,21 @@ WHITE, BLACK = 1, 2
 TT_SIZE_MB = 128
 SEARCH_DEPTH = 16
 TIME_LIMIT_MS = 5000
+POLL_INTERVAL_S = 0.05
+# Потоков Lazy SMP на один поиск. Сервер ведёт много партий сразу, и каждая ищет в
+# своём потоке, поэтому по умолчанию один; больше имеет смысл при одной-двух партиях
+SEARCH_THREADS = max(1, min(int(os.environ.get("KESTOG_THREADS", 1)), os.cpu_count() or 1))
+# Файл для ТТ: знания движка (в первую очередь дебют) переживают перезапуск сервера
+TT_FILE = os.environ.get("KESTOG_TT_FILE", "")
+# Обдумывание на времени игрока (KESTOG_PONDER=1 включает). Оно занимает ядра, пока
+# человек думает, поэтому за раз обдумывает не больше одной партии сервера
+PONDER = os.environ.get("KESTOG_PONDER", "0") == "1"
+# Каталог с эндшпильными таблицами (строятся утилитой kestog_tbgen)
+TB_DIR = os.environ.get("KESTOG_TB_DIR", "")
+# Файл весов нейросетевой оценки (без него - встроенная оценка)
+NNUE_FILE = os.environ.get("KESTOG_NNUE", "")
+# Дебютная книга (строится утилитой kestog_book): ходы из неё играются без поиска
+BOOK_FILE = os.environ.get("KESTOG_BOOK", "")
 
 # --- ТАБЛИЦА ДЛЯ ЧЕЛОВЕКО-ЧИТАЕМОГО ЛОГИРОВАНИЯ ---
 IDX_TO_ALG = [
@@ -22,18 +37,113 @@ IDX_TO_ALG = [
 ]
 
 # --- Инициализация C++ движка ---
-kestog_core.init_engine(TT_SIZE_MB)
+kestog_core.init_engine(TT_SIZE_MB, SEARCH_THREADS, TT_FILE, NNUE_FILE)
+if NNUE_FILE:
+    print(f"--- [ЛОГ] Оценка: {'NNUE' if kestog_core.nnue_enabled() else 'встроенная (веса не загружены)'} ---")
+if TB_DIR:
+    print(f"--- [ЛОГ] Эндшпильные таблицы: до {kestog_core.tb_init(TB_DIR)} фигур ---")
+if BOOK_FILE:
+    print(f"--- [ЛОГ] Дебютная книга: {kestog_core.book_init(BOOK_FILE)} позиций ---")
 
 # --- Веб-сервер FastAPI ---
 app = FastAPI()
 app.mount("/static", StaticFiles(directory="static"), name="static")
 
+@app.on_event("shutdown")
+def save_engine_state():
+    if kestog_core.save_transposition_table():
+        print(f"--- [ЛОГ] ТТ сохранена в {TT_FILE} ---")
+
+def format_pv(pv):
+    return " ".join(f"{IDX_TO_ALG[m.mask_from.bit_length() - 1]}{':' if m.captured_pieces else '-'}"
+                    f"{IDX_TO_ALG[m.mask_to.bit_length() - 1]}" for m in pv)
+
 @app.get("/")
 async def read_root(): return FileResponse('static/index.html')
 
+def same_position(a, b):
+    return a.white_men == b.white_men and a.black_men == b.black_men and a.kings == b.kings
+
+def make_progress_sink(thinking):
+    # Вызывается из потока движка (под GIL): только запоминаем, отправляет цикл опроса
+    def on_progress(progress):
+        if progress.multipv == 1:
+            thinking.append({"type": "engine_thinking", "depth": progress.depth, "score": progress.score,
+                             "nodes": progress.nodes, "nps": progress.nps, "pv": format_pv(progress.pv)})
+    return on_progress
+
+# Партия, которая сейчас обдумывает (одна на процесс)
+pondering_session = None
+
+class EngineSession:
+    """Поиск одной партии: хендл (им же идёт обдумывание), токен остановки и ход мысли."""
+
+    def __init__(self):
+        self.handle = kestog_core.SearchHandle()
+        self.stop_token = kestog_core.StopToken()
+        self.thinking = []
+        self.ponder_board = None
+        # Колбэк держит только список, а не сессию: иначе сессия и хендл ссылались бы
+        # друг на друга через C++ и не освобождались бы
+        self.on_progress = make_progress_sink(self.thinking)
+
+    def start_pondering(self, board, result):
+        # Позиция после ожидаемого ответа игрока (второй ход главного варианта). Если ответ
+        # предсказать нечем, обдумываем позицию игрока целиком: ТТ прогреется для всех ответов.
+        global pondering_session
+        if pondering_session not in (None, self) and pondering_session.handle.is_pondering():
+            return  # ядра уже заняты обдумыванием другой партии
+        pondering_session = self
+        self.thinking.clear()
+        if len(result.pv) >= 2:
+            self.ponder_board = kestog_core.apply_move(board, result.pv[1], WHITE)
+            self.handle.ponder(self.ponder_board, BLACK, SEARCH_DEPTH, TIME_LIMIT_MS,
+                               stop_token=self.stop_token, on_progress=self.on_progress)
+        else:
+            self.ponder_board = None
+            self.handle.ponder(board, WHITE, SEARCH_DEPTH, TIME_LIMIT_MS, stop_token=self.stop_token)
+
+    async def search(self, board, color, websocket):
+        # Поиск идёт в фоновом потоке движка без GIL; цикл событий продолжает
+        # обслуживать остальные партии, пока мы периодически опрашиваем хендл
+        # и пересылаем клиенту последнюю завершённую итерацию.
+        # Если игрок сделал ожидаемый ход, продолжаем обдумывание (или сразу берём его
+        # результат, если оно уже закончилось).
+        self.release_ponder_slot()
+        if self.ponder_board is not None and same_position(self.ponder_board, board):
+            print("--- [ЛОГ] Ход угадан: обдумывание продолжается как обычный поиск ---")
+            self.handle.ponderhit()
+        else:
+            self.thinking.clear()
+            self.handle.start(board, color, SEARCH_DEPTH, TIME_LIMIT_MS,
+                              stop_token=self.stop_token, on_progress=self.on_progress)
+        self.ponder_board = None
+        try:
+            while not self.handle.poll():
+                await asyncio.sleep(POLL_INTERVAL_S)
+                if self.thinking:
+                    latest = self.thinking[-1]
+                    self.thinking.clear()
+                    await websocket.send_json(latest)
+        finally:
+            self.handle.stop()
+        return self.handle.result()
+
+    def release_ponder_slot(self):
+        global pondering_session
+        if pondering_session is self:
+            pondering_session = None
+
+    def close(self):
+        # Игрок ушёл: всё, что ещё ищется для этой партии, останавливается
+        self.release_ponder_slot()
+        self.stop_token.request_stop()
+        self.handle.stop()
+
 @app.websocket("/ws")
 async def websocket_endpoint(websocket: WebSocket):
     await websocket.accept()
+    session = EngineSession()
     
     initial_board = kestog_core.Bitboard()
     initial_board.white_men = 4095
@@ -108,12 +218,13 @@ async def websocket_endpoint(websocket: WebSocket):
                     continue
 
                 print("\n--- [ЛОГ] Сервер инициирует ход движка. Начинаю поиск... ---")
-                result = kestog_core.find_best_move(current_board, BLACK, SEARCH_DEPTH, TIME_LIMIT_MS)
+                result = await session.search(current_board, BLACK, websocket)
                 
                 if result.best_move.mask_from != 0:
                     from_idx = result.best_move.mask_from.bit_length() - 1
                     to_idx = result.best_move.mask_to.bit_length() - 1
                     print(f"--- [ЛОГ] Движок выбрал ход: {IDX_TO_ALG[from_idx]} -> {IDX_TO_ALG[to_idx]} (индексы {from_idx} -> {to_idx}) ---")
+                    print(f"--- [ЛОГ] {'Ход из книги' if result.from_book else 'Главный вариант: ' + format_pv(result.pv)} ---")
                     
                     current_board = kestog_core.apply_move(current_board, result.best_move, BLACK)
                     
@@ -125,6 +236,8 @@ async def websocket_endpoint(websocket: WebSocket):
                     if not player_moves:
                         await websocket.send_json({"type": "game_over", "message": "Вы победили (у вас нет ходов)!"})
                     else:
+                        if PONDER:
+                            session.start_pondering(current_board, result)
                         await websocket.send_json({
                             "type": "board_update", 
                             "board": {"white_men": str(current_board.white_men), "black_men": str(current_board.black_men), "kings": str(current_board.kings)}, 
@@ -137,3 +250,5 @@ async def websocket_endpoint(websocket: WebSocket):
 
     except WebSocketDisconnect:
         print("Client disconnected")
+    finally:
+        session.close()
@@ -0,0 +1,105 @@
+// perft.cpp
+// Консольная утилита для проверки и замера генератора ходов.
+//
+//   kestog_perft                         - прогон эталонной таблицы, код возврата 1 при расхождении
+//   kestog_perft divide <wm> <bm> <kings> <color> <depth>
+//                                        - разбивка perft по ходам корня для произвольной позиции
+
+#include "KestoG_Core.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace kestog_core;
+
+namespace {
+    constexpr u64 sq(int i) { return 1ULL << i; }
+    int square_of(u64 mask) { return __builtin_ctzll(mask); }
+
+    // --- Эталонные значения perft ---
+    // Индексация полей как в main.py (IDX_TO_ALG): 0 = b1, 31 = g8; белые ходят вверх.
+    struct PerftReference {
+        const char* name;
+        Bitboard board;
+        int color_to_move;
+        int depth_count;
+        long long nodes[10]; // nodes[d - 1] = perft(d)
+    };
+
+    const PerftReference REFERENCES[] = {
+        {"start", {4095, 4293918720ULL, 0, 0}, 1, 10,
+         {7, 49, 302, 1469, 7473, 37628, 187302, 907385, 4426418, 21548633}},
+        {"start_after_d3c4", {(4095 & ~sq(9)) | sq(13), 4293918720ULL, 0, 0}, 2, 8,
+         {7, 40, 175, 886, 4322, 21312, 100571, 490784}},
+        {"kings_mixed",
+         {sq(0) | sq(5) | sq(6) | sq(9) | sq(13), sq(18) | sq(20) | sq(21) | sq(26) | sq(31),
+          sq(0) | sq(13) | sq(18) | sq(31), 0}, 1, 7,
+         {9, 65, 398, 2678, 15868, 103739, 614978}},
+        {"kings_only",
+         {sq(1) | sq(30), sq(12) | sq(19) | sq(27), sq(1) | sq(30) | sq(12) | sq(19) | sq(27), 0}, 1, 7,
+         {10, 24, 134, 1181, 6500, 92234, 594470}},
+        {"king_multijump",
+         {sq(0) | sq(4), sq(9) | sq(10) | sq(13) | sq(18) | sq(22) | sq(25), sq(0), 0}, 1, 7,
+         {4, 26, 132, 618, 2976, 12829, 67786}},
+        {"promotion_race",
+         {sq(2) | sq(16) | sq(20) | sq(21), sq(9) | sq(10) | sq(11) | sq(27), sq(16) | sq(27), 0}, 1, 8,
+         {2, 9, 80, 511, 4102, 25916, 209152, 1341312}},
+    };
+
+    double elapsed_seconds(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    int run_reference_suite() {
+        int failures = 0;
+        long long total_nodes = 0;
+        double total_time = 0;
+        for (const auto& ref : REFERENCES) {
+            for (int depth = 1; depth <= ref.depth_count; ++depth) {
+                auto start = std::chrono::steady_clock::now();
+                long long nodes = perft(ref.board, ref.color_to_move, depth);
+                double seconds = elapsed_seconds(start);
+                total_nodes += nodes;
+                total_time += seconds;
+                bool ok = nodes == ref.nodes[depth - 1];
+                if (!ok) ++failures;
+                std::printf("%-18s depth %2d  nodes %12lld  expected %12lld  %8.3f s  %7.2f Mnps  %s\n",
+                            ref.name, depth, nodes, ref.nodes[depth - 1], seconds,
+                            seconds > 0 ? nodes / seconds / 1e6 : 0.0, ok ? "ok" : "MISMATCH");
+            }
+        }
+        std::printf("total nodes %lld  time %.3f s  %.2f Mnps  %s\n", total_nodes, total_time,
+                    total_time > 0 ? total_nodes / total_time / 1e6 : 0.0,
+                    failures ? "FAILED" : "all ok");
+        return failures ? 1 : 0;
+    }
+
+    int run_divide(const Bitboard& board, int color_to_move, int depth) {
+        auto start = std::chrono::steady_clock::now();
+        long long total = 0;
+        for (const auto& entry : perft_divide(board, color_to_move, depth)) {
+            const Move& m = entry.first;
+            std::printf("%2d -> %2d  captured %08llx  %lld\n", square_of(m.mask_from), square_of(m.mask_to),
+                        (unsigned long long)m.captured_pieces, entry.second);
+            total += entry.second;
+        }
+        double seconds = elapsed_seconds(start);
+        std::printf("total %lld  %.3f s  %.2f Mnps\n", total, seconds, seconds > 0 ? total / seconds / 1e6 : 0.0);
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    init_engine(1);
+    if (argc == 7 && std::strcmp(argv[1], "divide") == 0) {
+        Bitboard board{std::strtoull(argv[2], nullptr, 0), std::strtoull(argv[3], nullptr, 0),
+                       std::strtoull(argv[4], nullptr, 0), 0};
+        return run_divide(board, std::atoi(argv[5]), std::atoi(argv[6]));
+    }
+    if (argc != 1) {
+        std::fprintf(stderr, "usage: %s [divide <white_men> <black_men> <kings> <color> <depth>]\n", argv[0]);
+        return 2;
+    }
+    return run_reference_suite();
+}
@@ -0,0 +1,64 @@
+// selfplay.cpp
+// Генерация обучающих данных самоигрой.
+//
+//   kestog_selfplay <out_file> [--games N] [--nodes N] [--random-plies N] [--max-plies N]
+//                   [--threads N] [--seed N] [--tt MB] [--tb DIR] [--nnue FILE]
+//
+// Партии идут параллельно (по однопоточному поиску на ядро) с фиксированным числом
+// узлов на ход и случайным дебютом. Позиции с оценкой поиска и исходом партии
+// дописываются в out_file записями SelfPlayRecord (16 байт, см. KestoG_Core.hpp).
+
+#include "KestoG_Core.hpp"
+#include "KestoG_Tablebase.hpp"
+#include "KestoG_NNUE.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace kestog_core;
+
+int main(int argc, char** argv) {
+    SelfPlayConfig config;
+    int tt_mb = 64;
+    const char* tb_dir = nullptr;
+    const char* nnue_path = "";
+    const char* out_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--games") && has_value) config.games = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--nodes") && has_value) config.nodes_per_move = std::atoll(argv[++i]);
+        else if (!std::strcmp(argv[i], "--random-plies") && has_value) config.random_plies = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--max-plies") && has_value) config.max_plies = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threads") && has_value) config.num_workers = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed") && has_value) config.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--tt") && has_value) tt_mb = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--tb") && has_value) tb_dir = argv[++i];
+        else if (!std::strcmp(argv[i], "--nnue") && has_value) nnue_path = argv[++i];
+        else if (argv[i][0] != '-' && !out_path) out_path = argv[i];
+        else {
+            out_path = nullptr;
+            break;
+        }
+    }
+    if (!out_path) {
+        std::fprintf(stderr, "usage: %s <out_file> [--games N] [--nodes N] [--random-plies N] [--max-plies N]\n"
+                             "       [--threads N] [--seed N] [--tt MB] [--tb DIR] [--nnue FILE]\n", argv[0]);
+        return 2;
+    }
+
+    set_info_output(false);
+    init_engine(tt_mb, 1, "", nnue_path);
+    if (tb_dir) std::fprintf(stderr, "tablebases: up to %d pieces\n", tb_init(tb_dir));
+    if (*nnue_path) std::fprintf(stderr, "nnue: %s\n", nnue_enabled() ? "loaded" : "failed, built-in evaluation");
+
+    SelfPlayStats stats = selfplay(out_path, config);
+    if (!stats.ok) {
+        std::fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+    std::printf("games %lld (white %lld, black %lld, draws %lld)  positions %lld  nodes %lld\n",
+                stats.games, stats.white_wins, stats.black_wins, stats.draws, stats.positions, stats.nodes);
+    std::printf("time %.1f s  workers %d  %.0f positions/s/core\n",
+                stats.time_s, stats.workers, stats.positions_per_second_per_core);
+    return 0;
+}
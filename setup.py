@@ -1,14 +1,28 @@
 # setup.py
 
+import os
 from setuptools import setup, Extension
+from setuptools.command.build_ext import build_ext
 import pybind11
 
+# По умолчанию сборка переносимая: ядра NNUE на AVX2 выбираются при запуске, если их
+# поддерживает процессор. KESTOG_NATIVE=1 - сборка под процессор сборочной машины
+# (аппаратный popcount и т.п.); такие модуль и утилиты на старых процессорах падают с SIGILL.
+ARCH_ARGS = ['-march=native'] if os.environ.get('KESTOG_NATIVE') == '1' else []
+
+# KESTOG_STATS=1 - сборка со счётчиками профилирования поиска (SearchStats): они
+# замедляют поиск, поэтому в обычной сборке их код не компилируется.
+STATS_ARGS = ['-DKESTOG_STATS'] if os.environ.get('KESTOG_STATS') == '1' else []
+
 # Определяем наш C++ модуль как "расширение" (Extension) для Python
 ext_modules = [
     Extension(
         'kestog_core',  # Имя модуля, которое будет использоваться в Python (import kestog_core)
         [
             'KestoG_Core.cpp',  # Исходный файл с игровой логикой
+            'KestoG_Tablebase.cpp',  # Эндшпильные таблицы
+            'KestoG_NNUE.cpp',  # Нейросетевая оценка
+            'KestoG_Book.cpp',  # Дебютная книга
             'bindings.cpp'      # Исходный файл с "мостом" pybind11
         ],
         # Указываем, где искать заголовочные файлы.
@@ -26,10 +40,43 @@ ext_modules = [
             '-fPIC',            # Position-Independent Code (обязательно для разделяемых библиотек)
             '-Wall',            # Включить основные предупреждения компилятора
             '-Wextra'           # Включить дополнительные предупреждения
-        ]
+        ] + ARCH_ARGS + STATS_ARGS
     )
 ]
 
+# Консольные утилиты движка, которые собираются вместе с модулем:
+# имя исполняемого файла -> список исходников
+TOOLS = {
+    'kestog_perft': ['perft.cpp', 'KestoG_Core.cpp', 'KestoG_Tablebase.cpp', 'KestoG_NNUE.cpp', 'KestoG_Book.cpp'],  # perft и замер скорости генератора ходов
+    'kestog_bench': ['bench.cpp', 'KestoG_Core.cpp', 'KestoG_Tablebase.cpp', 'KestoG_NNUE.cpp', 'KestoG_Book.cpp'],  # бенчмарк поиска с JSON-отчётом
+    'kestog_tbgen': ['tbgen.cpp', 'KestoG_Core.cpp', 'KestoG_Tablebase.cpp', 'KestoG_NNUE.cpp', 'KestoG_Book.cpp'],  # построение эндшпильных таблиц
+    'kestog_selfplay': ['selfplay.cpp', 'KestoG_Core.cpp', 'KestoG_Tablebase.cpp', 'KestoG_NNUE.cpp', 'KestoG_Book.cpp'],  # обучающие данные самоигрой
+    'kestog_book': ['bookgen.cpp', 'KestoG_Core.cpp', 'KestoG_Tablebase.cpp', 'KestoG_NNUE.cpp', 'KestoG_Book.cpp'],  # построение дебютной книги
+}
+TOOL_COMPILE_ARGS = ['-std=c++17', '-O3', '-Wall', '-Wextra', '-pthread'] + ARCH_ARGS + STATS_ARGS
+TOOL_LINK_ARGS = ['-pthread']
+
+
+class BuildExtWithTools(build_ext):
+    """Собирает расширение, а затем утилиты из TOOLS тем же компилятором."""
+
+    def run(self):
+        super().run()
+        output_dir = '.' if self.inplace else self.build_lib
+        for name, sources in TOOLS.items():
+            objects = self.compiler.compile(
+                sources,
+                output_dir=os.path.join(self.build_temp, name),
+                extra_postargs=TOOL_COMPILE_ARGS,
+            )
+            self.compiler.link_executable(
+                objects, name,
+                output_dir=output_dir,
+                extra_postargs=TOOL_LINK_ARGS,
+                target_lang='c++',
+            )
+
+
 # Запускаем процесс сборки
 setup(
     name='kestog_core',
@@ -37,4 +84,5 @@ setup(
     author='AI Guru & Team', # Автор
     description='High-performance giveaway checkers core module',
     ext_modules=ext_modules, # Указываем список расширений для сборки
+    cmdclass={'build_ext': BuildExtWithTools}, # Вместе с модулем собираем утилиты из TOOLS
 )
@@ -148,6 +148,9 @@ document.addEventListener('DOMContentLoaded', () => {
                 // Клиент теперь полностью пассивен и ждет команд от сервера.
                 // =================================================================
 
+            } else if (data.type === 'engine_thinking') {
+                // Ход мысли движка: последняя завершённая итерация поиска
+                statusElement.textContent = `Ход движка... глубина ${data.depth}, оценка ${data.score}, ${data.pv}`;
             } else if (data.type === 'error') {
                 statusElement.textContent = `Ошибка: ${data.message}`;
                 isPlayerTurn = true; // Возвращаем ход игроку после ошибки
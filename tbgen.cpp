@@ -0,0 +1,64 @@
+// tbgen.cpp
+// Построение эндшпильных таблиц (WDL) для поддавков.
+//
+//   kestog_tbgen <dir> [max_pieces] [threads]
+//   kestog_tbgen --check <dir>      - проверка подключения таблиц, код возврата 1 при ошибке
+//
+// Уже построенные таблицы в каталоге пропускаются, так что набор можно наращивать.
+
+#include "KestoG_Core.hpp"
+#include "KestoG_Tablebase.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+using namespace kestog_core;
+
+namespace {
+    // Повторный tb_init заменяет набор таблиц целиком: каталог без таблиц отключает
+    // пробу, возврат к каталогу подключает её снова
+    int run_check(const char* dir) {
+        const Bitboard two_kings = {1ULL << 0, 1ULL << 31, (1ULL << 0) | (1ULL << 31), 0};
+        int failures = 0;
+        auto expect = [&](const char* what, int value, bool ok) {
+            if (!ok) ++failures;
+            std::printf("%-36s %3d  %s\n", what, value, ok ? "ok" : "FAILED");
+        };
+        int loaded = tb_init(dir);
+        expect("tb_init(dir)", loaded, loaded >= 2);
+        int value = tb_probe(two_kings, 1);
+        expect("probe 1v1 kings", value, value != TB_UNKNOWN);
+        int reloaded = tb_init(std::string(dir) + "/nonexistent");
+        expect("tb_init(dir/nonexistent)", reloaded, reloaded == 0 && tb_max_pieces() == 0);
+        value = tb_probe(two_kings, 1);
+        expect("probe 1v1 kings without tables", value, value == TB_UNKNOWN);
+        reloaded = tb_init(dir);
+        expect("tb_init(dir) again", reloaded, reloaded == loaded);
+        std::printf("%s\n", failures ? "FAILED" : "all ok");
+        return failures ? 1 : 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    set_info_output(false);
+    if (argc == 3 && std::strcmp(argv[1], "--check") == 0) {
+        init_engine(1);
+        return run_check(argv[2]);
+    }
+    if (argc < 2 || argc > 4) {
+        std::fprintf(stderr, "usage: %s <dir> [max_pieces=4] [threads=all]\n       %s --check <dir>\n", argv[0], argv[0]);
+        return 2;
+    }
+    int max_pieces = argc > 2 ? std::atoi(argv[2]) : 4;
+    int threads = argc > 3 ? std::atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    init_engine(1);
+
+    auto start = std::chrono::steady_clock::now();
+    int generated = tb_generate(argv[1], max_pieces, threads);
+    if (generated < 0) return 1;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("generated %d table(s) in %.1f s, complete up to %d pieces\n", generated, seconds, tb_max_pieces());
+    return 0;
+}